@@ -9,6 +9,9 @@ const char* vertexSource = R"(
     precision highp float;
 
 	uniform mat4 MVP;			// Model-View-Projection matrix in row-major format
+	uniform vec4 positionDecode;	// offset (xy) and scale (zw) of the stored positions, quantized positions arrive in [0,1]
+	uniform vec3 curveColor;		// color of the strip when the vertices carry no color
+	uniform int perVertexColor;		// 1 if attribute array 1 is enabled
 
 	layout(location = 0) in vec2 vertexPosition;	// Attrib Array 0
 	layout(location = 1) in vec3 vertexColor;	    // Attrib Array 1
@@ -16,8 +19,9 @@ const char* vertexSource = R"(
 	out vec3 color;									// output attribute
 
 	void main() {
-		color = vertexColor;														// copy color from input to output
-		gl_Position =  vec4(vertexPosition.x, vertexPosition.y, 0, 1) * MVP; 		// transform to clipping space
+		color = (perVertexColor != 0) ? vertexColor : curveColor;					// copy color from input to output
+		vec2 position = positionDecode.xy + vertexPosition * positionDecode.zw;		// decode to world space
+		gl_Position =  vec4(position.x, position.y, 0, 1) * MVP; 					// transform to clipping space
 	}
 )";
 
@@ -34,6 +38,129 @@ const char* fragmentSource = R"(
 	}
 )";
 
+// vertex shader of the control points, one screen aligned quad per instance
+const char* pointVertexSource = R"(
+	#version 330
+    precision highp float;
+
+	uniform mat4 MVP;			// Model-View-Projection matrix in row-major format
+	uniform vec2 pointSize;		// half size of a control point in normalized device coordinates
+
+	layout(location = 0) in vec2 corner;			// Attrib Array 0, corner of the unit quad
+	layout(location = 1) in vec2 pointPosition;		// Attrib Array 1, one per instance
+	layout(location = 2) in int pointState;			// Attrib Array 2, one per instance: 0 normal, 1 hovered, 2 selected, 3 marker,
+													// 4 and up a cell of 2^(pointState - 3) or more aggregated points
+
+	out vec3 color;									// output attribute
+
+	void main() {
+		if (pointState >= 4) color = mix(vec3(1, 0, 0), vec3(1, 0.8, 0.8), float(pointState - 4) / 15.0);	// the more points the paler
+		else if (pointState == 3) color = vec3(0, 1, 1);	// marker: cyan
+		else if (pointState == 2) color = vec3(1, 1, 1);	// selected: white
+		else if (pointState == 1) color = vec3(1, 0.5, 0);	// hovered: orange
+		else color = vec3(1, 0, 0);							// red
+		gl_Position = vec4(pointPosition.x, pointPosition.y, 0, 1) * MVP + vec4(corner * pointSize, 0, 0);
+	}
+)";
+
+// vertex shader of the wide lines, one screen aligned quad per segment of the strips
+const char* wideLineVertexSource = R"(
+	#version 330
+    precision highp float;
+
+	uniform mat4 MVP;				// Model-View-Projection matrix in row-major format
+	uniform vec4 positionDecode;	// offset (xy) and scale (zw) of the stored positions, quantized positions arrive in [0,1]
+	uniform vec3 curveColor;		// color of the strip when the vertices carry no color
+	uniform int perVertexColor;		// 1 if the color of a vertex follows its position
+	uniform int texelsPerVertex;	// 1 if a texel holds the position, otherwise the floats of an interleaved vertex
+	uniform samplerBuffer strips;	// the vertex buffer of the strips
+	uniform usamplerBuffer stripFlags;	// per vertex: 1 first of its strip, 2 last of its strip
+	uniform vec2 viewportSize;		// in pixels
+	uniform float halfWidth;		// in pixels
+	uniform int lineJoin;			// 0 round, 1 miter
+	uniform int lineCap;			// 0 round, 1 butt, 2 square
+	uniform float miterLimit;		// longest miter in half widths, longer ones are rounded
+
+	out vec3 color;									// output attribute
+	noperspective out vec2 local;					// pixels along the segment from its start and across it
+	flat out float segmentLength;					// in pixels
+	flat out int roundStart, roundEnd;				// the ends where the fragments off the capsule are discarded
+
+	vec2 pixelsOf(int i) {							// position of vertex i in pixels
+		vec2 stored = (texelsPerVertex == 1) ? texelFetch(strips, i).xy
+			: vec2(texelFetch(strips, i * texelsPerVertex).x, texelFetch(strips, i * texelsPerVertex + 1).x);
+		vec2 position = positionDecode.xy + stored * positionDecode.zw;	// decode to world space
+		vec4 clip = vec4(position.x, position.y, 0, 1) * MVP;
+		return (clip.xy / clip.w * 0.5 + 0.5) * viewportSize;
+	}
+
+	vec2 direction(vec2 from, vec2 to, vec2 fallback) {
+		vec2 d = to - from;
+		return dot(d, d) > 0 ? normalize(d) : fallback;
+	}
+
+	// the corner of a miter join between the directions is bisector * halfWidth * scale away on either side,
+	// returns false if the miter is longer than the limit or the line turns back
+	bool miter(vec2 dirIn, vec2 dirOut, vec2 normal, out vec2 bisector, out float scale) {
+		bisector = vec2(-dirIn.y, dirIn.x) + vec2(-dirOut.y, dirOut.x);
+		if (dot(bisector, bisector) < 1e-6) return false;
+		bisector = normalize(bisector);
+		scale = 1 / dot(bisector, normal);
+		return scale <= miterLimit;
+	}
+
+	void main() {
+		int i = gl_InstanceID;	// the segment from vertex i to vertex i + 1
+		uint flags0 = texelFetch(stripFlags, i).r, flags1 = texelFetch(stripFlags, i + 1).r;
+		if ((flags0 & 2u) != 0u) { gl_Position = vec4(2, 2, 2, 1); return; }	// joins two strips: clipped away
+
+		vec2 p0 = pixelsOf(i), p1 = pixelsOf(i + 1);
+		vec2 dir = direction(p0, p1, vec2(1, 0)), normal = vec2(-dir.y, dir.x);
+		bool capped0 = (flags0 & 1u) != 0u, capped1 = (flags1 & 2u) != 0u;
+		// the shape of both ends is decided by every vertex, so that the flat outputs agree whatever the provoking vertex
+		vec2 bisector0, bisector1;
+		float scale0, scale1;
+		bool mitered0 = !capped0 && lineJoin == 1 && miter(direction(pixelsOf(i - 1), p0, dir), dir, normal, bisector0, scale0);
+		bool mitered1 = !capped1 && lineJoin == 1 && miter(dir, direction(p1, pixelsOf(i + 2), dir), normal, bisector1, scale1);
+		bool rounded0 = capped0 ? lineCap == 0 : !mitered0, rounded1 = capped1 ? lineCap == 0 : !mitered1;
+		bool extended0 = capped0 ? lineCap != 1 : !mitered0, extended1 = capped1 ? lineCap != 1 : !mitered1; // by half a width
+
+		int end = gl_VertexID >> 1;							// 0 at p0, 1 at p1
+		float side = ((gl_VertexID & 1) == 0) ? -1 : 1;
+		vec2 corner;
+		if (end == 0) corner = p0 + (mitered0 ? bisector0 * scale0 * side : normal * side - (extended0 ? dir : vec2(0))) * halfWidth;
+		else corner = p1 + (mitered1 ? bisector1 * scale1 * side : normal * side + (extended1 ? dir : vec2(0))) * halfWidth;
+		local = vec2(dot(corner - p0, dir), dot(corner - p0, normal));
+		segmentLength = dot(p1 - p0, dir);
+		roundStart = rounded0 ? 1 : 0;
+		roundEnd = rounded1 ? 1 : 0;
+
+		int colorTexel = (i + end) * texelsPerVertex + 2;
+		color = (perVertexColor != 0) ? vec3(texelFetch(strips, colorTexel).x, texelFetch(strips, colorTexel + 1).x, texelFetch(strips, colorTexel + 2).x) : curveColor;
+		gl_Position = vec4(corner / viewportSize * 2 - 1, 0, 1);
+	}
+)";
+
+// fragment shader of the wide lines, cuts the rounded ends of the quads to half discs
+const char* wideLineFragmentSource = R"(
+	#version 330
+    precision highp float;
+
+	uniform float halfWidth;		// in pixels
+
+	in vec3 color;					// variable input: interpolated color of vertex shader
+	noperspective in vec2 local;
+	flat in float segmentLength;
+	flat in int roundStart, roundEnd;
+	out vec4 fragmentColor;			// output that goes to the raster memory as told by glBindFragDataLocation
+
+	void main() {
+		if (roundStart != 0 && local.x < 0 && length(local) > halfWidth) discard;
+		if (roundEnd != 0 && local.x > segmentLength && length(local - vec2(segmentLength, 0)) > halfWidth) discard;
+		fragmentColor = vec4(color, 1);
+	}
+)";
+
 //this class is 90% from the "Triangle with smooth color and interactive polyline"
 class Camera {
 	vec2 wCenter; // center in world coordinates
@@ -47,36 +174,354 @@ public:
 	mat4 Vinv() { return TranslateMatrix(wCenter); }
 	mat4 Pinv() { return ScaleMatrix(vec2(wSize.x / 2, wSize.y / 2)); }
 
+	vec2 Size() const { return wSize; }
+
 	void Zoom(float s) { wSize = wSize * s; }
 	void Pan(vec2 t) { wCenter = wCenter + t; }
 };
 
 Camera camera;		// 2D camera
 GPUProgram gpuProgram;	// vertex and fragment shaders
+GPUProgram pointProgram;	// vertex and fragment shaders of the control points
+GPUProgram wideLineProgram;	// vertex and fragment shaders of the curves drawn as wide lines
+
+// Control points stored as two separate 32 byte aligned arrays of x and y coordinates (structure of arrays).
+// Indexing returns a vec3 with z = 0, so code written for std::vector<vec3> keeps reading it the same way,
+// while the evaluation loops can stream xs() and ys() directly.
+// The arrays can also be a read-only view of memory owned by someone else (e.g. a mapped file),
+// they are copied only when the points are modified.
+class PointArray {
+	float* x = nullptr;
+	float* y = nullptr;
+	size_t n = 0, capacity = 0;
+	std::shared_ptr<const void> source;	// keeps the viewed arrays alive, null if the arrays are owned
+
+	static float* Allocate(size_t count) {
+#if defined(_WIN32)
+		return (float*)_aligned_malloc(count * sizeof(float), 32);
+#else
+		void* p = nullptr;
+		return (posix_memalign(&p, 32, count * sizeof(float)) == 0) ? (float*)p : nullptr;
+#endif
+	}
+
+	static void Free(float* p) {
+#if defined(_WIN32)
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	}
+
+	void Own() { if (source) Reallocate(n > 16 ? n : 16); } // copy a view before writing into it
+
+	void Reallocate(size_t newCapacity) {
+		float* newX = Allocate(newCapacity);
+		float* newY = Allocate(newCapacity);
+		if (n > 0) {
+			memcpy(newX, x, n * sizeof(float));
+			memcpy(newY, y, n * sizeof(float));
+		}
+		if (!source) { Free(x); Free(y); }
+		source.reset();
+		x = newX; y = newY;
+		capacity = newCapacity;
+	}
+
+public:
+	PointArray() { }
+	PointArray(const PointArray& other) { *this = other; }
+	PointArray& operator=(const PointArray& other) {
+		if (this == &other) return *this;
+		n = 0;
+		Own();
+		reserve(other.n);
+		n = other.n;
+		if (n > 0) {
+			memcpy(x, other.x, n * sizeof(float));
+			memcpy(y, other.y, n * sizeof(float));
+		}
+		return *this;
+	}
+	~PointArray() { if (!source) { Free(x); Free(y); } }
+
+	size_t size() const { return n; }
+	bool empty() const { return n == 0; }
+	void erase_front(size_t count) { // remove the first count points
+		Own();
+		if (count > n) count = n;
+		n -= count;
+		memmove(x, x + count, n * sizeof(float));
+		memmove(y, y + count, n * sizeof(float));
+	}
+	void clear() { n = 0; Own(); }
+	void reserve(size_t count) { if (count > capacity) Reallocate(count); }
+	void resize(size_t count) { reserve(count); n = count; }
+
+	void push_back(const vec3& point) {
+		if (n == capacity) Reallocate(capacity > 0 ? capacity * 2 : 16);
+		x[n] = point.x;
+		y[n] = point.y;
+		n++;
+	}
+
+	vec3 operator[](size_t i) const { return vec3(x[i], y[i], 0); }
+	vec3 back() const { return vec3(x[n - 1], y[n - 1], 0); }
+	void set(size_t i, const vec3& point) { Own(); x[i] = point.x; y[i] = point.y; }
+
+	// show the first count points of the arrays xs and ys without copying them, the source keeps them alive.
+	// Viewing more of the same arrays later just grows the view, so the points must not be modified until
+	// the last of them is viewed: a copy would no longer line up with the arrays.
+	void view(const float* xs, const float* ys, size_t count, std::shared_ptr<const void> _source) {
+		if (source && x == xs) { n = capacity = count; return; }
+		if (!source) { Free(x); Free(y); }
+		x = const_cast<float*>(xs); y = const_cast<float*>(ys);	// never written while viewed
+		n = capacity = count;
+		source = _source;
+	}
+	bool isView() const { return source != nullptr; }
+
+	const float* xs() const { return x; }
+	const float* ys() const { return y; }
+};
+
+// Kinds of curves, the numbers are stored in curve files
+enum CurveType { CURVE_LAGRANGE = 0, CURVE_BEZIER = 1, CURVE_CATMULLROM = 2, CURVE_PIECEWISE_BEZIER = 3, CURVE_BSPLINE = 4 };
+
+// Arc length of a curve as a function of its parameter, for sampling and moving along it at equal distances.
+// The parameter range is cut at the given breaks and every piece is integrated with 5 point Gauss-Legendre
+// quadrature of the speed, halving it until the halves agree with the whole. Between the ends of the spans
+// the arc length is the cubic Hermite interpolant of their lengths and speeds, so the parameter of an arc length
+// is a binary search and a few Newton steps on a cubic, without evaluating the curve again.
+class ArcLengthTable {
+	struct Span {
+		float t0, t1;		// parameter range
+		float s0, s1;		// arc length from the start of the curve at its ends
+		float v0, v1;		// speed |dr/dt| at its ends
+		int piece;			// passed to the position function
+	};
+	std::vector<Span> spans;
+	float absoluteTolerance = 0;	// length errors below this are accepted however long the span
+
+	static const int maxDepth = 4;	// halvings of a piece
+
+	template<typename Speed>
+	static float Integrate(const Speed& speed, float a, float b) {
+		static const float x[5] = { 0, -0.5384693101f, 0.5384693101f, -0.9061798459f, 0.9061798459f };
+		static const float w[5] = { 0.5688888889f, 0.4786286705f, 0.4786286705f, 0.2369268851f, 0.2369268851f };
+		float center = (a + b) / 2, half = (b - a) / 2, sum = 0;
+		for (int i = 0; i < 5; i++) sum += w[i] * speed(center + half * x[i]);
+		return sum * half;
+	}
+
+	template<typename Speed>
+	void Subdivide(const Speed& speed, int piece, float a, float b, float va, float vb, float whole, int depth, double& s) {
+		float m = (a + b) / 2, vm = speed(m);
+		float left = Integrate(speed, a, m), right = Integrate(speed, m, b);
+		// the halves must agree with the whole, and the Hermite cubic of the whole must hit the length of the left half
+		float tolerance = fmaxf(1e-4f * (left + right), absoluteTolerance), hermite = whole / 2 + (b - a) * (va - vb) / 8;
+		if (depth == maxDepth || (fabsf(left + right - whole) <= tolerance && fabsf(hermite - left) <= tolerance)) {
+			spans.push_back({ a, m, (float)s, (float)(s + left), va, vm, piece });
+			s += left;
+			spans.push_back({ m, b, (float)s, (float)(s + right), vm, vb, piece });
+			s += right;
+			return;
+		}
+		Subdivide(speed, piece, a, m, va, vm, left, depth + 1, s);
+		Subdivide(speed, piece, m, b, vm, vb, right, depth + 1, s);
+	}
+
+public:
+	// position(piece, t) is the point at t, where piece is the index of the break before t if pieces is true, else -1,
+	// velocity(piece, t, v) sets dr/dt or returns false, then the speed comes from central differences of the positions,
+	// spans are halved until their length is within 1e-4 relative or the given absolute error
+	template<typename Position, typename Velocity>
+	void Build(const float* breaks, int numBreaks, bool pieces, const Position& position, const Velocity& velocity, float tolerance = 0) {
+		spans.clear();
+		absoluteTolerance = tolerance;
+		double s = 0;
+		for (int i = 0; i + 1 < numBreaks; i++) {
+			float a = breaks[i], b = breaks[i + 1];
+			if (!(b > a)) continue;
+			int piece = pieces ? i : -1;
+			float h = (b - a) * 1e-2f;
+			auto speed = [&](float t) {
+				vec3 d;
+				if (!velocity(piece, t, d)) {	// the differences stay inside the piece, the curve may not be smooth at the breaks
+					float t0 = fmaxf(a, t - h), t1 = fminf(b, t + h);
+					d = (position(piece, t1) - position(piece, t0)) / (t1 - t0);
+				}
+				return sqrtf(d.x * d.x + d.y * d.y);
+			};
+			Subdivide(speed, piece, a, b, speed(a), speed(b), Integrate(speed, a, b), 0, s);
+		}
+	}
+
+	bool Empty() const { return spans.empty(); }
+	int NumSpans() const { return (int)spans.size(); }
+	float Length() const { return spans.empty() ? 0 : spans.back().s1; }
+
+	// the parameter at arc length s from the start, clamped to the curve, and the piece it is in
+	float Parameter(float s, int& piece) const {
+		if (spans.empty()) { piece = -1; return 0; }
+		size_t k = std::lower_bound(spans.begin(), spans.end(), s, [](const Span& span, float s) { return span.s1 < s; }) - spans.begin();
+		const Span& span = spans[std::min(k, spans.size() - 1)];
+		piece = span.piece;
+		if (s <= span.s0) return span.t0;
+		if (s >= span.s1) return span.t1;
+		// safeguarded Newton iteration on the Hermite cubic of the arc length over u in [0, 1]
+		float h = span.t1 - span.t0, lo = 0, hi = 1;
+		float u = (s - span.s0) / (span.s1 - span.s0);
+		for (int iteration = 0; iteration < 8; iteration++) {
+			float u2 = u * u, u3 = u2 * u;
+			float f = (2 * u3 - 3 * u2 + 1) * span.s0 + (u3 - 2 * u2 + u) * h * span.v0 + (-2 * u3 + 3 * u2) * span.s1 + (u3 - u2) * h * span.v1 - s;
+			float df = (6 * u2 - 6 * u) * (span.s0 - span.s1) + (3 * u2 - 4 * u + 1) * h * span.v0 + (3 * u2 - 2 * u) * h * span.v1;
+			if (f > 0) hi = u; else lo = u;
+			float next = (df > 0) ? u - f / df : (lo + hi) / 2;
+			if (fabsf(next - u) < 1e-6f) break;
+			u = (next > lo && next < hi) ? next : (lo + hi) / 2;	// bisect if Newton left the bracket
+		}
+		return span.t0 + h * u;
+	}
+};
+
+// A polynomial plane curve as the Chebyshev series of its coordinates over its parameter range, in double precision.
+// The series is fitted to the values at the Chebyshev points cos(pi k / n) by one DCT-I and cut where its coefficients
+// become negligible. A sample then costs one Clenshaw recurrence over the coefficients, and the samples at all
+// Chebyshev points of a grid come from one inverse DCT-I, O(m log m) for m samples.
+class ChebyshevSeries {
+	double a = 0, b = 0;				// parameter range, mapped to [-1, 1]
+	std::vector<double> cx, cy;		// coefficients of T_0, T_1, ... of the coordinates
+	std::vector<double> dx, dy;		// of their derivatives by the parameter
+
+	// x[k] = the sum of x[j] cos(pi j k / n) over j = 0..n, with the first and the last terms halved, for k = 0..n,
+	// and the same for y. One complex FFT of length 2n of the even extensions, the real part is the transform of x
+	// and the imaginary part that of y, n is a power of two.
+	static void DctI(double* x, double* y, int n) {
+		int size = 2 * n;
+		FrameVector<double> re(size), im(size);
+		for (int k = 0; k <= n; k++) { re[k] = x[k]; im[k] = y[k]; }
+		for (int k = 1; k < n; k++) { re[size - k] = x[k]; im[size - k] = y[k]; }
+		for (int i = 1, j = 0; i < size; i++) { // bit reversed order
+			int bit = size >> 1;
+			for (; j & bit; bit >>= 1) j ^= bit;
+			j ^= bit;
+			if (i < j) { std::swap(re[i], re[j]); std::swap(im[i], im[j]); }
+		}
+		for (int length = 2; length <= size; length <<= 1) {
+			for (int k = 0; k < length / 2; k++) {
+				double wr = cos(-2 * M_PI * k / length), wi = sin(-2 * M_PI * k / length);
+				for (int i = k; i < size; i += length) {
+					int j = i + length / 2;
+					double tr = re[j] * wr - im[j] * wi, ti = re[j] * wi + im[j] * wr;
+					re[j] = re[i] - tr; im[j] = im[i] - ti;
+					re[i] += tr; im[i] += ti;
+				}
+			}
+		}
+		for (int k = 0; k <= n; k++) { x[k] = re[k] / 2; y[k] = im[k] / 2; } // the extension counts the inner terms twice
+	}
+
+	static void Clenshaw(const std::vector<double>& cx, const std::vector<double>& cy, double u, double& x, double& y) {
+		double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+		for (int k = (int)cx.size() - 1; k >= 1; k--) {
+			double xk = cx[k] + 2 * u * x1 - x2, yk = cy[k] + 2 * u * y1 - y2;
+			x2 = x1; x1 = xk;
+			y2 = y1; y1 = yk;
+		}
+		x = cx[0] + u * x1 - x2;
+		y = cy[0] + u * y1 - y2;
+	}
+
+	double Map(double t) const { return b > a ? fmin(1.0, fmax(-1.0, (2 * t - a - b) / (b - a))) : 0; }
+
+public:
+	bool Empty() const { return cx.empty(); }
+	int Degree() const { return (int)cx.size() - 1; }
+	void Clear() { cx.clear(); cy.clear(); dx.clear(); dy.clear(); }
+
+	// fit to a curve that is a polynomial of at most the given degree on [tStart, tEnd], sample(ts, count, xs, ys)
+	// sets the coordinates of the curve at count parameters. Fails and stays empty if the rounding errors, about 1e-13
+	// of the largest coefficient, would exceed the tolerance, as they do for curves that are huge between small values.
+	template<typename Sample>
+	bool Fit(double tStart, double tEnd, int degree, double tolerance, const Sample& sample) {
+		a = tStart; b = tEnd;
+		int n = 1;
+		while (n < degree) n <<= 1;
+		FrameVector<double> t(n + 1);
+		for (int k = 0; k <= n; k++) t[k] = a + (b - a) * (cos(M_PI * k / n) + 1) / 2;
+		cx.resize(n + 1); cy.resize(n + 1);
+		sample(t.data(), n + 1, cx.data(), cy.data());
+		DctI(cx.data(), cy.data(), n);
+		for (int k = 0; k <= n; k++) { cx[k] *= 2.0 / n; cy[k] *= 2.0 / n; }
+		cx[0] /= 2; cy[0] /= 2; cx[n] /= 2; cy[n] /= 2;
+
+		// a polynomial of the degree has no coefficients beyond it, those of the transform are rounding errors,
+		// and the coefficients below the rounding errors of the largest are dropped too
+		int length = std::min(n, degree) + 1;
+		double largest = 0;
+		for (int k = 0; k < length; k++) largest = fmax(largest, fmax(fabs(cx[k]), fabs(cy[k])));
+		if (!(1e-13 * largest <= tolerance)) { Clear(); return false; } // also if a sample was not finite
+		while (length > 1 && fabs(cx[length - 1]) <= 1e-13 * largest && fabs(cy[length - 1]) <= 1e-13 * largest) length--;
+		cx.resize(length); cy.resize(length);
+
+		// T'_k from T_(k-1) and T'_(k-2), then by the chain rule of the mapping of the parameter
+		dx.assign(length + 1, 0); dy.assign(length + 1, 0);
+		for (int k = length - 1; k >= 1; k--) {
+			dx[k - 1] = dx[k + 1] + 2 * k * cx[k];
+			dy[k - 1] = dy[k + 1] + 2 * k * cy[k];
+		}
+		dx[0] /= 2; dy[0] /= 2;
+		double scale = b > a ? 2 / (b - a) : 0;
+		for (int k = 0; k <= length; k++) { dx[k] *= scale; dy[k] *= scale; }
+		dx.resize(std::max(1, length - 1)); dy.resize(std::max(1, length - 1));
+		return true;
+	}
+
+	vec3 Evaluate(double t) const {
+		double x, y;
+		Clenshaw(cx, cy, Map(t), x, y);
+		return vec3((float)x, (float)y, 0);
+	}
+
+	vec3 Velocity(double t) const {
+		double x, y;
+		Clenshaw(dx, dy, Map(t), x, y);
+		return vec3((float)x, (float)y, 0);
+	}
+
+	// the curve at the m + 1 Chebyshev points of the parameter range in increasing order of the parameter,
+	// m is a power of two not less than the degree
+	void EvaluateAtChebyshevPoints(int m, FrameVector<vec3>& points) const {
+		FrameVector<double> x(m + 1, 0), y(m + 1, 0);
+		for (int k = 0; k <= Degree(); k++) { x[k] = cx[k]; y[k] = cy[k]; }
+		x[0] *= 2; y[0] *= 2; x[m] *= 2; y[m] *= 2; // the sum of the series halves them
+		DctI(x.data(), y.data(), m);
+		points.resize(m + 1);
+		for (int k = 0; k <= m; k++) points[k] = vec3((float)x[m - k], (float)y[m - k], 0); // cos(pi k / m) decreases with k
+	}
+};
 
 //this class was called LineStrip in the base program, I modified to fit the Curve
 class Curve {
 public:
-	unsigned int		vao, vbo;	// vertex array object, vertex buffer object
-	std::vector<vec3>   controlPoints; // interleaved data of coordinates and colors
+	PointArray          controlPoints; // control points in modeling space
 	std::vector<float> ts; // knots
-	std::vector<float>  vertexData; // interleaved data of coordinates and colors
+	std::vector<float>  vertexData; // coordinates of the tessellated curve, the scene packs them in its vertex layout
 	vec2			    wTranslate; // translation
-	int selectedPointIndex;
-
-	void create() {
-		glGenVertexArrays(1, &vao);
-		glBindVertexArray(vao);
-
-		glGenBuffers(1, &vbo); // Generate 1 vertex buffer object
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		// Enable the vertex attribute arrays
-		glEnableVertexAttribArray(0);  // attribute array 0
-		glEnableVertexAttribArray(1);  // attribute array 1
-		// Map attribute array 0 to the vertex data of the interleaved vbo
-		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), reinterpret_cast<void*>(0)); // attribute array, components/attribute, component type, normalize?, stride, offset
-		// Map attribute array 1 to the color data of the interleaved vbo
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), reinterpret_cast<void*>(2 * sizeof(float)));
+	int selectedPointIndex = -1;
+	int hoveredPointIndex = -1;
+	bool dirty = true; // the control points changed since the last tessellation
+	int dirtyPointFirst = INT_MAX, dirtyPointLast = -1; // moved control points that are not on the GPU yet
+	int changedVertexFirst = 0, changedVertexLast = INT_MAX; // vertices written by the last Tessellate, the scene uploads only these
+	ArcLengthTable arcLength; // of the control points when it was last built
+	bool arcLengthStale = true; // the control points changed since then
+
+	// remember that control point i moved, so the scene uploads only the changed positions
+	void MarkPointDirty(int i) {
+		if (i < dirtyPointFirst) dirtyPointFirst = i;
+		if (i > dirtyPointLast) dirtyPointLast = i;
+		dirty = true;
 	}
 
 	mat4 M() { // modeling transform
@@ -97,15 +542,31 @@ public:
 		// input pipeline
 		vec4 mVertex = vec4(cX, cY, 0, 1) * camera.Pinv() * camera.Vinv() * Minv();
 		controlPoints.push_back(vec3(mVertex.x, mVertex.y, 0.0f));
+		dirty = true;
 	}
 
 	virtual vec3 r(float t) = 0; //pure virtual, the approximations must calculate it themselves
 
-	
+	virtual CurveType Type() const = 0;
+
+	// the parameters of the start and the end of the curve
+	virtual void ParameterRange(float& tStart, float& tEnd) const {
+		tStart = ts.empty() ? 0 : ts.front();
+		tEnd = ts.empty() ? 0 : ts.back();
+	}
+
+	// evaluate at t knowing that it lies in segment i, splines use it to skip the search for the segment
+	virtual vec3 rSegment(int i, float t) { return r(t); }
+
+	// dr/dt at t in segment i (or anywhere if i < 0), false if the curve has no closed form of it
+	virtual bool Velocity(int i, float t, vec3& v) { return false; }
+
+	virtual ~Curve() { }
 
 	void Clear() {
 		controlPoints.clear();
 		ts.clear();
+		dirty = true;
 	}
 
 	int ClosestIndex(float cX, float cY) {
@@ -113,8 +574,10 @@ public:
 		float threshold = 0.1f; // this can be adjusted
 		int closestPointIndex = -1;
 		vec4 mVertex = vec4(cX, cY, 0, 1) * camera.Pinv() * camera.Vinv() * Minv();
-		for (unsigned int i = 0; i < controlPoints.size(); i++) {
-			if (fabs(controlPoints[i].x - mVertex.x) < threshold && fabs(controlPoints[i].y - mVertex.y) < threshold)
+		const float* xs = controlPoints.xs();
+		const float* ys = controlPoints.ys();
+		for (int i = 0; i < (int)controlPoints.size(); i++) {
+			if (fabsf(xs[i] - mVertex.x) < threshold && fabsf(ys[i] - mVertex.y) < threshold)
 				closestPointIndex = i;
 		}
 		if (closestPointIndex != -1) {
@@ -127,58 +590,167 @@ public:
 	}
 
 	void UpdatePoint(float cX, float cY, int index) {
+		if (index < 0 || index >= (int)controlPoints.size()) return; // nothing is selected
 		vec4 mVertex = vec4(cX, cY, 0, 1) * camera.Pinv() * camera.Vinv() * Minv();
-		controlPoints[index] = vec3(mVertex.x, mVertex.y, 0.0f);
+		controlPoints.set(index, vec3(mVertex.x, mVertex.y, 0.0f));
+		MarkPointDirty(index);
 	}
-	//this spline draws itself a bit differently 
-	void Draw() {
-		if (controlPoints.size() > 0) {
-			vertexData.clear();
-			// generate the curve points
-			int numSections = 100;
-			for (unsigned int i = 0; i < controlPoints.size() - 1; i++) {
-				for (unsigned int j = 0; j <= numSections; j++) {
-					float t = ts[i] + (ts[i + 1] - ts[i]) * ((float)j / numSections); //evenly spaced between the two control points
-					vec3 point = r(t);
-					vertexData.push_back(point.x);
-					vertexData.push_back(point.y);
-					vertexData.push_back(1); // red
-					vertexData.push_back(1); // green
-					vertexData.push_back(0); // blue
-				}
-			}
 
-			// add control points to vertex data
-			for (auto& point : controlPoints) {
-				vertexData.push_back(point.x);
-				vertexData.push_back(point.y);
-				vertexData.push_back(1); // red
-				vertexData.push_back(0); // green
-				vertexData.push_back(0); // blue
-			}
-			// copy data to the GPU
-			glBindBuffer(GL_ARRAY_BUFFER, vbo);
-			glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(float), &vertexData[0], GL_DYNAMIC_DRAW);
+	static constexpr int maxStripVertices = 1 << 21;	// 16 MB of floats per curve
+
+	// append a vertex in world space, the scene draws every curve with the same MVP
+	void AddVertex(vec3 point) {
+		vertexData.push_back(point.x + wTranslate.x);
+		vertexData.push_back(point.y + wTranslate.y);
+	}
+
+	static constexpr float arcLengthSpacing = 0.075f;	// between the vertices, 1.5 pixels at the initial zoom
+
+	// the arc length table over the knots, or over equal parameter pieces, one per control point, if there are none
+	void BuildArcLength() {
+		bool knotted = ts.size() == controlPoints.size();
+		FrameVector<float> breaks;
+		if (knotted) breaks.assign(ts.begin(), ts.end());
+		else {
+			float tStart, tEnd;
+			ParameterRange(tStart, tEnd);
+			int numPieces = std::max(1, (int)controlPoints.size() - 1);
+			breaks.resize(numPieces + 1);
+			for (int i = 0; i <= numPieces; i++) breaks[i] = tStart + (tEnd - tStart) * i / numPieces;
+		}
+		arcLength.Build(breaks.data(), (int)breaks.size(), knotted, [this](int piece, float t) { return piece >= 0 ? rSegment(piece, t) : r(t); },
+			[this](int piece, float t, vec3& v) { return Velocity(piece, t, v); }, arcLengthSpacing * 1e-2f);
+		arcLengthStale = false;
+	}
+
+	const ArcLengthTable& ArcLength() {
+		if (arcLengthStale) BuildArcLength();
+		return arcLength;
+	}
 
-			// set GPU uniform matrix variable MVP with the content of CPU variable MVPTransform
-			mat4 MVPTransform = M() * camera.V() * camera.P();
-			gpuProgram.setUniform(MVPTransform, "MVP");
+	// the point at arc length s from the start in modeling space, clamped to the curve
+	vec3 PointAtLength(float s) {
+		const ArcLengthTable& table = ArcLength();
+		if (table.Empty()) return controlPoints.size() > 0 ? controlPoints[0] : vec3(0, 0, 0);
+		int piece;
+		float t = table.Parameter(s, piece);
+		return piece >= 0 ? rSegment(piece, t) : r(t);
+	}
 
-			// draw the curve
-			glBindVertexArray(vao);
-			glLineWidth(2.0f);
-			glDrawArrays(GL_LINE_STRIP, 0, (controlPoints.size() - 1) * (numSections + 1));
+	// vertices at equal arc lengths arcLengthSpacing apart, but at most maxSections + 1 of them, so long segments
+	// get as many vertices as short ones need for the same look. False if the spacing had to be wider.
+	bool TessellateByLength(int maxSections) {
+		vertexData.clear();
+		BuildArcLength();
+		if (arcLength.Empty()) return true;
+		float length = arcLength.Length();
+		int numSections = std::max(1, std::min(maxSections, (int)ceilf(length / arcLengthSpacing)));
+		size_t size = ((size_t)numSections + 1) * 2;
+		if (vertexData.capacity() < size) vertexData.reserve(size + size / 2);	// room to get longer while it is dragged
+		for (int j = 0; j <= numSections; j++) {
+			int piece;
+			float t = arcLength.Parameter(length * j / numSections, piece);
+			AddVertex(piece >= 0 ? rSegment(piece, t) : r(t));
+		}
+		profiler().count("samples evaluated", vertexData.size() / 2);
+		return numSections < maxSections || length <= arcLengthSpacing * maxSections;
+	}
 
-			// draw the control points
-			glPointSize(10.0f);
-			glDrawArrays(GL_POINTS, (controlPoints.size() - 1) * (numSections + 1), controlPoints.size());
+	// numSections + 1 vertices evenly spaced in the parameter of every segment
+	void TessellateUniform(int numSections) {
+		vertexData.clear();
+		int numSegments = (int)controlPoints.size() - 1;
+		vertexData.reserve((size_t)std::max(numSegments, 0) * (numSections + 1) * 2);
+		for (int i = 0; i < numSegments; i++) {
+			for (int j = 0; j <= numSections; j++) {
+				float t = ts[i] + (ts[i + 1] - ts[i]) * ((float)j / numSections); //evenly spaced between the two control points
+				AddVertex(rSegment(i, t));
+			}
 		}
+		profiler().count("samples evaluated", vertexData.size() / 2);
+	}
+
+	//this spline draws itself a bit differently 
+	virtual void Tessellate() {
+		// at most 100 sections per segment, fewer when there are so many segments (e.g. a loaded survey)
+		// that the strip would not fit into the vertex buffer
+		int numSegments = (int)controlPoints.size() - 1;
+		if (numSegments <= 0) { vertexData.clear(); return; }
+		int numSections = std::max(1, std::min(100, maxStripVertices / numSegments - 1));
+		// equal arc lengths need fewer vertices, unless the curve is so long for its segments (e.g. a noisy survey,
+		// or a Lagrange curve swinging far out between its knots) that they would be at least as many as the uniform
+		// ones, judging by the length of the control polygon first
+		const float* xs = controlPoints.xs();
+		const float* ys = controlPoints.ys();
+		double polygonLength = 0;
+		for (int i = 0; i < numSegments; i++) polygonLength += sqrtf((xs[i + 1] - xs[i]) * (xs[i + 1] - xs[i]) + (ys[i + 1] - ys[i]) * (ys[i + 1] - ys[i]));
+		long long maxSections = (long long)numSegments * (numSections + 1) - 1;
+		if (polygonLength / arcLengthSpacing >= maxSections || !TessellateByLength((int)maxSections)) TessellateUniform(numSections);
+	}
+};
+
+// A curve that is a single polynomial of its parameter. Unless it is evaluated term by term, every tessellation
+// converts it to a Chebyshev series first, so a sample costs O(degree) instead of a basis function of every control
+// point, and the samples of high degrees all come from one inverse DCT of the series.
+class PolynomialCurve : public Curve {
+protected:
+	ChebyshevSeries series;	// of the control points at the last tessellation, empty when evaluated term by term
+
+	static const int multipointDegree = 128;	// series at least this long are sampled at once
+
+	// the curve at count parameters in double precision, to fit the series to
+	virtual void Samples(const double* t, int count, double* x, double* y) = 0;
+	virtual vec3 rTerms(float t) = 0;
+	virtual bool VelocityTerms(float t, vec3& v) { return false; }
+
+	// about numSamples vertices at the Chebyshev points of the parameter range, false if the series is too short
+	// for that to pay off or is not fitted
+	bool TessellateMultipoint(int numSamples) {
+		if (series.Empty() || series.Degree() < multipointDegree) return false;
+		int m = 1;
+		while (m < std::max(numSamples, series.Degree()) && m < maxStripVertices / 2) m <<= 1;
+		FrameVector<vec3> points;
+		series.EvaluateAtChebyshevPoints(m, points);
+		vertexData.clear();
+		vertexData.reserve(points.size() * 2);
+		for (const vec3& point : points) AddVertex(point);
+		profiler().count("multipoint samples", points.size());
+		return true;
+	}
+
+public:
+	bool termByTerm = false;	// sum the basis functions of the control points for every sample
+
+	// false if the curve is evaluated term by term, either by choice or because the series would not be accurate
+	// to 1e-5 of the extent of the control points
+	bool FitSeries() {
+		series.Clear();
+		if (termByTerm || controlPoints.empty()) return false;
+		float tStart, tEnd;
+		ParameterRange(tStart, tEnd);
+		const float* xs = controlPoints.xs();
+		const float* ys = controlPoints.ys();
+		float extent = 0;
+		for (size_t i = 1; i < controlPoints.size(); i++) extent = fmaxf(extent, fmaxf(fabsf(xs[i] - xs[0]), fabsf(ys[i] - ys[0])));
+		return series.Fit(tStart, tEnd, (int)controlPoints.size() - 1, 1e-5 * fmax(extent, 1e-3),
+			[this](const double* t, int count, double* x, double* y) { Samples(t, count, x, y); });
+	}
+
+	const ChebyshevSeries& Series() const { return series; }
+
+	vec3 r(float t) override { return series.Empty() ? rTerms(t) : series.Evaluate(t); }
+
+	bool Velocity(int, float t, vec3& v) override {
+		if (series.Empty()) return VelocityTerms(t, v);
+		v = series.Velocity(t);
+		return true;
 	}
 };
 
 //this algorithm is from the ppt 
-class Lagrange : public Curve {
+class Lagrange : public PolynomialCurve {
 public:
+	CurveType Type() const override { return CURVE_LAGRANGE; }
 
 	float L(int i, float t) {
 		float Li = 1.0f;
@@ -196,77 +768,348 @@ public:
 		ts.push_back(ti);
 	}
 
-	vec3 r(float t) {
-		vec3 rt(0, 0, 0);
-		for (unsigned int i = 0; i < controlPoints.size(); i++) {
-			rt = rt + controlPoints[i] * L(i, t);
+	// prod (t - t_j) over the knots but the skipped one as a mantissa and an exponent, the products of many
+	// differences would leave the range of doubles
+	double KnotProduct(double t, int skip, int& exponent) const {
+		double product = 1;
+		int e;
+		exponent = 0;
+		for (int j = 0; j < (int)ts.size(); j++) {
+			if (j == skip) continue;
+			product *= t - ts[j];
+			if ((j & 31) == 31) { product = frexp(product, &e); exponent += e; }
 		}
-		return rt;
+		product = frexp(product, &e);
+		exponent += e;
+		return product;
 	}
-	void Draw() {
-		Curve::Draw();
+
+	// the first barycentric form l(t) sum w_i p_i / (t - t_i), with l(t) = prod (t - t_j) and the weights
+	// w_i = 1 / prod (t_i - t_j), which stays accurate however the knots are spaced
+	void Samples(const double* t, int count, double* x, double* y) override {
+		const float* xs = controlPoints.xs();
+		const float* ys = controlPoints.ys();
+		int n = (int)controlPoints.size();
+		FrameVector<double> w(n);
+		FrameVector<int> exponents(n);
+		int largest = INT_MIN;
+		for (int i = 0; i < n; i++) {
+			w[i] = 1 / KnotProduct(ts[i], i, exponents[i]);
+			exponents[i] = -exponents[i];
+			largest = std::max(largest, exponents[i]);
+		}
+		for (int i = 0; i < n; i++) w[i] = ldexp(w[i], exponents[i] - largest);
+		for (int k = 0; k < count; k++) {
+			int exponent;
+			double l = KnotProduct(t[k], -1, exponent), sx = 0, sy = 0;
+			if (l == 0) { // at a knot
+				int i = (int)(std::find(ts.begin(), ts.end(), (float)t[k]) - ts.begin());
+				x[k] = xs[std::min(i, n - 1)]; y[k] = ys[std::min(i, n - 1)];
+				continue;
+			}
+			for (int i = 0; i < n; i++) {
+				double c = w[i] / (t[k] - ts[i]);
+				sx += c * xs[i]; sy += c * ys[i];
+			}
+			x[k] = ldexp(l * sx, exponent + largest);
+			y[k] = ldexp(l * sy, exponent + largest);
+		}
+	}
+
+	vec3 rTerms(float t) override {
+		const float* xs = controlPoints.xs();
+		const float* ys = controlPoints.ys();
+		float x = 0, y = 0;
+		for (int i = 0; i < (int)controlPoints.size(); i++) {
+			float Li = L(i, t);
+			x += xs[i] * Li;
+			y += ys[i] * Li;
+		}
+		return vec3(x, y, 0);
+	}
+
+	void Tessellate() override {
+		FitSeries();
+		int numSegments = (int)controlPoints.size() - 1;
+		if (numSegments <= 0 || !TessellateMultipoint((int)std::min<long long>(100LL * numSegments, maxStripVertices - 1))) Curve::Tessellate();
 	}
 };
 
 //this algorithm is from the ppt 
-class Bezier : public Curve {
+class Bezier : public PolynomialCurve {
 public:
+	CurveType Type() const override { return CURVE_BEZIER; }
+	void ParameterRange(float& tStart, float& tEnd) const override { tStart = 0; tEnd = 1; }
 	float B(int i, float t) {
 		int n = controlPoints.size() - 1; // n+1 pts!
 		float choose = 1;
 		for (unsigned int j = 1; j <= i; j++) choose *= (float)(n - j + 1) / j;
 		return choose * pow(t, i) * pow(1 - t, n - i);
 	}
+
+	// the Bernstein polynomials are summed outwards from the largest one, at about (n + 1) t, until they become
+	// negligible, so the binomials of high degrees neither overflow nor get multiplied by powers that underflow.
+	// The largest binomial comes from a table of log factorials, lgamma would write signgam from several threads.
+	void Samples(const double* t, int count, double* x, double* y) override {
+		const float* xs = controlPoints.xs();
+		const float* ys = controlPoints.ys();
+		int n = (int)controlPoints.size() - 1;
+		FrameVector<double> logFactorial(n + 1, 0);
+		for (int i = 1; i <= n; i++) logFactorial[i] = logFactorial[i - 1] + log((double)i);
+		for (int k = 0; k < count; k++) {
+			double u = t[k];
+			if (n == 0 || u <= 0 || u >= 1) { int i = (n > 0 && u >= 1) ? n : 0; x[k] = xs[i]; y[k] = ys[i]; continue; }
+			int mode = std::min(n, (int)(u * (n + 1)));
+			double peak = exp(logFactorial[n] - logFactorial[mode] - logFactorial[n - mode] + mode * log(u) + (n - mode) * log1p(-u));
+			double ratio = u / (1 - u), sx = peak * xs[mode], sy = peak * ys[mode], Bi = peak;
+			for (int i = mode; i < n && Bi > 1e-17 * peak; i++) {
+				Bi *= ratio * (n - i) / (i + 1);
+				sx += Bi * xs[i + 1]; sy += Bi * ys[i + 1];
+			}
+			Bi = peak;
+			for (int i = mode; i > 0 && Bi > 1e-17 * peak; i--) {
+				Bi *= i / (ratio * (n - i + 1));
+				sx += Bi * xs[i - 1]; sy += Bi * ys[i - 1];
+			}
+			x[k] = sx; y[k] = sy;
+		}
+	}
+
+	vec3 rTerms(float t) override {
+		const float* xs = controlPoints.xs();
+		const float* ys = controlPoints.ys();
+		float x = 0, y = 0;
+		for (int i = 0; i < (int)controlPoints.size(); i++) {
+			float Bi = B(i, t);
+			x += xs[i] * Bi;
+			y += ys[i] * Bi;
+		}
+		return vec3(x, y, 0);
+	}
+	// n times the Bezier curve of degree n - 1 of the differences of the control points
+	bool VelocityTerms(float t, vec3& v) override {
+		const float* xs = controlPoints.xs();
+		const float* ys = controlPoints.ys();
+		int n = (int)controlPoints.size() - 1;
+		float x = 0, y = 0, choose = 1;
+		for (int i = 0; i < n; i++) {
+			float Bi = choose * powf(t, (float)i) * powf(1 - t, (float)(n - 1 - i));
+			x += (xs[i + 1] - xs[i]) * Bi;
+			y += (ys[i + 1] - ys[i]) * Bi;
+			choose = choose * (n - 1 - i) / (i + 1);
+		}
+		v = vec3(x * n, y * n, 0);
+		return true;
+	}
+
+	void Tessellate() override {
+		FitSeries();
+		if (controlPoints.size() == 0) vertexData.clear();
+		else if (!TessellateMultipoint(100)) TessellateByLength(100);
+	}
+};
+
+// Cubic Bezier pieces joined at their end points: control points 3k, 3k+1, 3k+2 and 3k+3 define piece k,
+// which spans the parameters k..k+1. The fitter produces these from dense polylines.
+class PiecewiseBezier : public Curve {
 public:
+	CurveType Type() const override { return CURVE_PIECEWISE_BEZIER; }
+
+	int NumPieces() const { return controlPoints.size() >= 4 ? (int)(controlPoints.size() - 1) / 3 : 0; }
+	void ParameterRange(float& tStart, float& tEnd) const override { tStart = 0; tEnd = (float)NumPieces(); }
+
+	vec3 Piece(int k, float u) const {
+		const float* xs = controlPoints.xs() + 3 * k;
+		const float* ys = controlPoints.ys() + 3 * k;
+		float v = 1 - u, b0 = v * v * v, b1 = 3 * u * v * v, b2 = 3 * u * u * v, b3 = u * u * u;
+		return vec3(b0 * xs[0] + b1 * xs[1] + b2 * xs[2] + b3 * xs[3], b0 * ys[0] + b1 * ys[1] + b2 * ys[2] + b3 * ys[3], 0);
+	}
+
+	void AddPoint(float cX, float cY) override {
+		Curve::AddPoint(cX, cY);
+		ts.push_back((ts.size()) / 3.0f);
+	}
 
 	vec3 r(float t) override {
-		vec3 rt(0, 0, 0);
-		for (unsigned int i = 0; i < controlPoints.size(); i++)
-			rt = rt + controlPoints[i] * B(i, t);
-		return rt;
+		int numPieces = NumPieces();
+		if (numPieces == 0) return vec3(0, 0, 0);
+		int k = std::min(std::max((int)t, 0), numPieces - 1);
+		return Piece(k, t - k);
+	}
+
+	void Tessellate() override {
+		vertexData.clear();
+		int numPieces = NumPieces();
+		if (numPieces == 0) return;
+		int numSections = std::max(1, std::min(32, maxStripVertices / numPieces - 1));
+		vertexData.reserve(((size_t)numPieces * numSections + 1) * 2);
+		for (int k = 0; k < numPieces; k++)
+			for (int j = (k == 0) ? 0 : 1; j <= numSections; j++) AddVertex(Piece(k, (float)j / numSections)); // pieces share end points
+		profiler().count("samples evaluated", vertexData.size() / 2);
+	}
+};
+
+// Cubic NURBS curve with clamped knots, so it starts at the first control point and ends at the last one.
+// A control point influences only the degree + 1 spans around it, so the vertices of every span are kept
+// in vertexData and an edit evaluates only the spans it changed, which the scene then uploads alone.
+class BSpline : public Curve {
+	static constexpr int maxDegree = 3;
+	static constexpr int maxSections = 16;	// per span
+	int cachedSections = 0;				// sections per span of the vertices in vertexData, 0 if there are none
+	int staleFirst = 0, staleLast = INT_MAX;	// spans to evaluate again
+
+	void Invalidate(int first, int last) {
+		staleFirst = std::min(staleFirst, std::max(first, 0));
+		staleLast = std::max(staleLast, last);
 	}
-	void Draw() {
-		if (controlPoints.size() >= 0) {
-			vertexData.clear();
-			// generate the curve points
-			int numSections = 100;
-			for (unsigned int i = 0; i <= numSections; i++) {
-				float t = (float)i / numSections;
-				vec3 point = r(t);
-				vertexData.push_back(point.x);
-				vertexData.push_back(point.y);
-				vertexData.push_back(1); // red
-				vertexData.push_back(1); // green
-				vertexData.push_back(0); // blue
-			}
 
-			// add control points to vertex data
-			//because I want to display the points with red, and the curves with yellow
-			for (auto& point : controlPoints) {
-				vertexData.push_back(point.x);
-				vertexData.push_back(point.y);
-				vertexData.push_back(1); // red
-				vertexData.push_back(0); // green
-				vertexData.push_back(0); // blue
+	// knot index k of the span with knots[k] <= u < knots[k + 1], the last span includes its end
+	int FindSpan(float u) const {
+		int p = Degree(), n = (int)controlPoints.size();
+		if (u >= knots[n]) return n - 1;
+		if (u <= knots[p]) return p;
+		return (int)(std::upper_bound(knots.begin() + p, knots.begin() + n + 1, u) - knots.begin()) - 1;
+	}
+
+	vec3 DeBoor(int k, float u) const { // in homogeneous coordinates, the weights make it rational
+		int p = Degree();
+		const float* xs = controlPoints.xs();
+		const float* ys = controlPoints.ys();
+		float dx[maxDegree + 1], dy[maxDegree + 1], dw[maxDegree + 1];
+		for (int j = 0; j <= p; j++) {
+			int i = k - p + j;
+			dw[j] = weights[i]; dx[j] = xs[i] * dw[j]; dy[j] = ys[i] * dw[j];
+		}
+		for (int level = 1; level <= p; level++) {
+			for (int j = p; j >= level; j--) {
+				int i = k - p + j;
+				float span = knots[i + p - level + 1] - knots[i];
+				float alpha = span > 0 ? (u - knots[i]) / span : 0;
+				dx[j] = (1 - alpha) * dx[j - 1] + alpha * dx[j];
+				dy[j] = (1 - alpha) * dy[j - 1] + alpha * dy[j];
+				dw[j] = (1 - alpha) * dw[j - 1] + alpha * dw[j];
 			}
+		}
+		return vec3(dx[p] / dw[p], dy[p] / dw[p], 0);
+	}
+
+	void UniformKnots() { // clamped: degree + 1 equal knots at both ends, unit spans between
+		int p = Degree(), n = (int)controlPoints.size();
+		knots.clear();
+		if (n < 2) return;
+		for (int i = 0; i <= n + p; i++) knots.push_back((float)std::min(std::max(i - p, 0), n - p));
+	}
+
+public:
+	std::vector<float> knots;	// controlPoints.size() + Degree() + 1 of them
+	std::vector<float> weights;	// one per control point
+
+	CurveType Type() const override { return CURVE_BSPLINE; }
+
+	int Degree() const { return std::max(1, std::min(maxDegree, (int)controlPoints.size() - 1)); }
+	int NumSpans() const { return controlPoints.size() >= 2 ? (int)controlPoints.size() - Degree() : 0; }
+
+	void ParameterRange(float& tStart, float& tEnd) const override {
+		int p = Degree(), n = (int)controlPoints.size();
+		bool valid = n >= 2 && (int)knots.size() == n + p + 1 && (int)weights.size() == n; // not yet after loading
+		tStart = valid ? knots[p] : 0;
+		tEnd = valid ? knots[n] : 0;
+	}
+
+	void AddPoint(float cX, float cY) override {
+		Curve::AddPoint(cX, cY);
+		weights.resize(controlPoints.size(), 1.0f);	// also after Clear
+		int p = Degree(), n = (int)controlPoints.size();
+		if (n <= maxDegree + 1 || (int)knots.size() + 1 != n + p + 1) { UniformKnots(); Invalidate(0, INT_MAX); return; }
+		// only the end is clamped again, the spans before it keep their knots
+		float end = knots.back();
+		knots.resize(knots.size() - p);
+		knots.insert(knots.end(), p + 1, end + 1);
+		Invalidate(NumSpans() - 1 - p, INT_MAX);
+	}
+
+	vec3 r(float t) override {
+		if (controlPoints.size() < 2) return vec3(0, 0, 0);
+		return DeBoor(FindSpan(t), t);
+	}
 
-			// copy data to the GPU
-			glBindBuffer(GL_ARRAY_BUFFER, vbo);
-			glBufferData(GL_ARRAY_BUFFER, vertexData.size() * sizeof(float), &vertexData[0], GL_DYNAMIC_DRAW);
+	void SetWeight(int i, float w) {
+		if (i < 0 || i >= (int)weights.size()) return;
+		weights[i] = w;
+		MarkPointDirty(i);
+	}
+
+	// Boehm's knot insertion: one more control point, the curve keeps its shape. Not while the curve has too few
+	// points for a cubic, as the degree would grow with the new point and the knots would start over as uniform.
+	bool InsertKnot(float u) {
+		int p = Degree(), n = (int)controlPoints.size();
+		if (p < maxDegree || u <= knots[p] || u >= knots[n]) return false;
+		int k = FindSpan(u);
+		PointArray points;
+		std::vector<float> newWeights;
+		const float* xs = controlPoints.xs();
+		const float* ys = controlPoints.ys();
+		for (int i = 0; i <= n; i++) {
+			float alpha = i <= k - p ? 1 : (i > k ? 0 : (u - knots[i]) / (knots[i + p] - knots[i]));
+			int a = std::min(i, n - 1), b = std::max(i - 1, 0);	// homogeneous blend of points i and i - 1
+			float w = alpha * weights[a] + (1 - alpha) * weights[b];
+			points.push_back(vec3((alpha * xs[a] * weights[a] + (1 - alpha) * xs[b] * weights[b]) / w,
+				(alpha * ys[a] * weights[a] + (1 - alpha) * ys[b] * weights[b]) / w, 0));
+			newWeights.push_back(w);
+		}
+		controlPoints = points;
+		weights = newWeights;
+		knots.insert(knots.begin() + k + 1, u);
+		selectedPointIndex = hoveredPointIndex = -1;
+		Invalidate(0, INT_MAX);
+		dirty = true;
+		return true;
+	}
 
-			// set GPU uniform matrix variable MVP with the content of CPU variable MVPTransform
-			mat4 MVPTransform = M() * camera.V() * camera.P();
-			gpuProgram.setUniform(MVPTransform, "MVP");
+	// knots and weights of a curve file for the control points viewed so far, appended from where the last call stopped;
+	// the spans evaluated before depend only on the knots and points before them, so only the new spans are evaluated
+	void ViewKnots(const float* fileKnots, const float* fileWeights) {
+		int p = Degree(), n = (int)controlPoints.size();
+		if (n < 2) return;
+		size_t first = knots.size();
+		knots.insert(knots.end(), fileKnots + first, fileKnots + n + p + 1);
+		weights.insert(weights.end(), fileWeights + weights.size(), fileWeights + n);
+		Invalidate(first > 0 ? (int)first - 2 * p - 1 : 0, INT_MAX);
+	}
 
-			// draw the curve
-			glBindVertexArray(vao);
-			glLineWidth(2.0f);
-			glDrawArrays(GL_LINE_STRIP, 0, numSections + 1);
+	// parameter where control point i pulls the most (Greville abscissa)
+	float Greville(int i) const {
+		int p = Degree();
+		float sum = 0;
+		for (int j = 1; j <= p; j++) sum += knots[i + j];
+		return sum / p;
+	}
 
-			// draw the control points
-			glPointSize(10.0f);
-			glDrawArrays(GL_POINTS, numSections + 1, controlPoints.size());
+	void Tessellate() override {
+		int n = (int)controlPoints.size(), p = Degree();
+		if (n < 2) { vertexData.clear(); cachedSections = 0; return; }
+		if ((int)knots.size() != n + p + 1) { UniformKnots(); Invalidate(0, INT_MAX); }	// e.g. loaded from a file
+		if ((int)weights.size() != n) { weights.resize(n, 1.0f); Invalidate(0, INT_MAX); }
+		int numSpans = NumSpans();
+		int sections = std::max(1, std::min(maxSections, maxStripVertices / numSpans - 1));
+		if (sections != cachedSections) { cachedSections = sections; Invalidate(0, INT_MAX); }
+		if (dirtyPointLast >= 0) Invalidate(dirtyPointFirst - p, dirtyPointLast);	// moved points or changed weights
+
+		vertexData.resize((size_t)numSpans * (sections + 1) * 2);
+		int first = staleFirst, last = std::min(staleLast, numSpans - 1);
+		for (int s = first; s <= last; s++) {
+			int k = p + s;
+			float* dst = &vertexData[(size_t)s * (sections + 1) * 2];
+			for (int j = 0; j <= sections; j++) {
+				vec3 point = DeBoor(k, knots[k] + (knots[k + 1] - knots[k]) * ((float)j / sections));
+				*dst++ = point.x + wTranslate.x;
+				*dst++ = point.y + wTranslate.y;
+			}
 		}
+		profiler().count("samples evaluated", std::max(0, last - first + 1) * (sections + 1));
+		changedVertexFirst = first * (sections + 1);
+		changedVertexLast = (last + 1) * (sections + 1) - 1;
+		staleFirst = INT_MAX; staleLast = -1;
 	}
 };
 
@@ -276,6 +1119,8 @@ class CatmullRom : public Curve {
 public:
 	float tension = 0.0f;
 
+	CurveType Type() const override { return CURVE_CATMULLROM; }
+
 	vec3 Hermite(vec3 p0, vec3 v0, float t0, vec3 p1, vec3 v1, float t1, float t) {
 		vec3 a0 = p0;
 		vec3 a1 = v0;
@@ -285,27 +1130,54 @@ public:
 	}
 
 	vec3 r(float t) {
-		for (int i = 0; i < controlPoints.size() - 1; i++) {
-			if (ts[i] <= t && t <= ts[i + 1]) {
-				vec3 v1; vec3 v0;
-				if (i > 0)
-					v0 = (1.0f - tension) * 0.5f * ((controlPoints[i + 1] - controlPoints[i]) / (ts[i + 1] - ts[i]) + (controlPoints[i] - controlPoints[i - 1]) / (ts[i] - ts[i - 1]));
-				else
-					v0 = (1.0f - tension) * 0.5f * (controlPoints[i + 1] - controlPoints[i]) / (ts[i + 1] - ts[i]);
+		// binary search for the segment with ts[i] <= t <= ts[i + 1]
+		if (controlPoints.size() < 2 || t < ts.front() || t > ts.back()) return vec3(0, 0, 0); // return zero vector if t is out of range
+		int i = (int)(std::upper_bound(ts.begin(), ts.end(), t) - ts.begin()) - 1;
+		if (i > (int)controlPoints.size() - 2) i = (int)controlPoints.size() - 2;
+		return rSegment(i, t);
+	}
 
-				if (i < controlPoints.size() - 2) 
-					v1 = (1.0f - tension) * 0.5f * ((controlPoints[i + 2] - controlPoints[i+1 ]) / (ts[i +2] - ts[i+1]) + (controlPoints[i+1] - controlPoints[i]) / (ts[i +1] - ts[i ]));
-				else 
-					v1 = (1.0f - tension) * 0.5f * (controlPoints[i + 1] - controlPoints[i]) / (ts[i + 1] - ts[i]);
-				
-				return Hermite(controlPoints[i], v0, ts[i], controlPoints[i + 1], v1, ts[i + 1], t);
-			}
-		}
-		return vec3(0, 0, 0); // return zero vector if t is out of range
+	// derivative of the Hermite curve above
+	vec3 HermiteVelocity(vec3 p0, vec3 v0, float t0, vec3 p1, vec3 v1, float t1, float t) {
+		vec3 a1 = v0;
+		vec3 a2 = 3 * (p1 - p0) / pow((t1 - t0), 2) - (v1 + 2 * v0) / (t1 - t0);
+		vec3 a3 = 2 * (p0 - p1) / pow((t1 - t0), 3) + (v1 + v0) / pow((t1 - t0), 2);
+		return a1 + 2 * a2 * (t - t0) + 3 * a3 * pow((t - t0), 2);
+	}
+
+	vec3 rSegment(int i, float t) override {
+		vec3 v0, v1;
+		Tangents(i, v0, v1);
+		return Hermite(controlPoints[i], v0, ts[i], controlPoints[i + 1], v1, ts[i + 1], t);
+	}
+
+	bool Velocity(int i, float t, vec3& v) override {
+		if (i < 0) return false;
+		vec3 v0, v1;
+		Tangents(i, v0, v1);
+		v = HermiteVelocity(controlPoints[i], v0, ts[i], controlPoints[i + 1], v1, ts[i + 1], t);
+		return true;
+	}
+
+	// the tangents at the ends of segment i
+	void Tangents(int i, vec3& v0, vec3& v1) {
+		if (i > 0)
+			v0 = (1.0f - tension) * 0.5f * ((controlPoints[i + 1] - controlPoints[i]) / (ts[i + 1] - ts[i]) + (controlPoints[i] - controlPoints[i - 1]) / (ts[i] - ts[i - 1]));
+		else
+			v0 = (1.0f - tension) * 0.5f * (controlPoints[i + 1] - controlPoints[i]) / (ts[i + 1] - ts[i]);
+
+		if (i < (int)controlPoints.size() - 2) 
+			v1 = (1.0f - tension) * 0.5f * ((controlPoints[i + 2] - controlPoints[i+1 ]) / (ts[i +2] - ts[i+1]) + (controlPoints[i+1] - controlPoints[i]) / (ts[i +1] - ts[i ]));
+		else 
+			v1 = (1.0f - tension) * 0.5f * (controlPoints[i + 1] - controlPoints[i]) / (ts[i + 1] - ts[i]);
 	}
 
 	void AddPoint(float cX, float cY) override {
 		Curve::AddPoint(cX, cY);
+		AddKnot();
+	}
+
+	void AddKnot() { // the knot of the last control point
 		if (controlPoints.size() == 1) {
 			//the first knot is 0
 			ts.push_back(0);
@@ -326,14 +1198,16 @@ public:
 		//recalculate the knots
 		if (controlPoints.size() > 0) {
 			ts.push_back(0);
-			for (unsigned int i = 1; i < controlPoints.size(); i++) {
-				vec3 diff = controlPoints[i] - controlPoints[i - 1];
-				float dist = sqrt(diff.x * diff.x + diff.y * diff.y);
-				ts.push_back(pow(dist, tension) + ts.back());
+			const float* xs = controlPoints.xs();
+			const float* ys = controlPoints.ys();
+			for (int i = 1; i < (int)controlPoints.size(); i++) {
+				float dx = xs[i] - xs[i - 1], dy = ys[i] - ys[i - 1];
+				float dist = sqrtf(dx * dx + dy * dy);
+				ts.push_back(powf(dist, tension) + ts.back());
 			}
 		}
-		//redraw the curve
-		Draw();
+		//the curve is tessellated again with the new knots on the next redraw
+		dirty = true;
 		printf("Tension is now: %f\n", tension);
 	}
 
@@ -342,94 +1216,2502 @@ public:
 		Curve::Clear();
 		tension = 0.0f;
 	}
+};
 
-	void Draw() {
-		Curve::Draw();
+// Catmull-Rom spline over a sliding window of the most recent points of a stream.
+// Every segment is tessellated into the same number of vertices, so a new point only re-evaluates the segments
+// whose tangents it changes. The window is compacted when it holds twice its size, which keeps the memory
+// bounded and the cost per point constant however long the stream runs.
+class StreamingCatmullRom : public CatmullRom {
+	size_t window;			// points kept after a compaction
+	int staleSegment = 0;	// the first segment whose vertices are out of date
+	float tessellatedTension = 0;
+
+	static const int numSections = 8; // the points of a stream are dense, fewer sections per segment suffice
+
+	void EvaluateSegment(int i) {
+		float* dst = &vertexData[(size_t)i * (numSections + 1) * 2];
+		for (int j = 0; j <= numSections; j++) {
+			float t = ts[i] + (ts[i + 1] - ts[i]) * ((float)j / numSections);
+			vec3 point = rSegment(i, t);
+			*dst++ = point.x + wTranslate.x;
+			*dst++ = point.y + wTranslate.y;
+		}
 	}
-};
 
-enum CurveType { NONE, BEZIER, LAGRANGE, CATMULLROM };
-CurveType currentCurve = NONE;
+	bool compacted = false;	// the vertices moved to the front since the last Tessellate
+
+	void Compact() { // drop the oldest points, keeping the last window
+		size_t drop = controlPoints.size() - window;
+		controlPoints.erase_front(drop);
+		float origin = ts[drop];	// knots restart from 0, so they do not lose precision over time
+		ts.erase(ts.begin(), ts.begin() + drop);
+		for (float& t : ts) t -= origin;
+		size_t floatsPerSegment = (numSections + 1) * 2;
+		vertexData.erase(vertexData.begin(), vertexData.begin() + std::min(vertexData.size(), drop * floatsPerSegment));
+		staleSegment = std::max(0, staleSegment - (int)drop);
+		if (staleSegment > 0) EvaluateSegment(0); // lost its left neighbor, so its start tangent changes
+		selectedPointIndex = selectedPointIndex >= (int)drop ? selectedPointIndex - (int)drop : -1;
+		hoveredPointIndex = hoveredPointIndex >= (int)drop ? hoveredPointIndex - (int)drop : -1;
+		compacted = true;
+	}
 
-Bezier bezier;
-Lagrange lagrange;
-CatmullRom catmullrom;
+public:
+	size_t pointsAdded = 0;	// since the stream started
 
-// Initialization, create an OpenGL context
-void onInitialization() {
-	glViewport(0, 0, 600, 600); 	// Position and size of the photograph on screen
-	glLineWidth(2.0f); // Width of lines in pixels
+	StreamingCatmullRom(size_t _window = 4096) : window(_window) {
+		controlPoints.reserve(2 * window);
+		ts.reserve(2 * window);
+		vertexData.reserve(2 * window * (numSections + 1) * 2);
+	}
 
-	// Create objects by setting up their vertex data on the GPU
-	bezier.create();
-	lagrange.create();
-	catmullrom.create();
+	// append a point given in modeling space
+	void AddModelPoint(float x, float y) {
+		if (controlPoints.size() == 2 * window) Compact();
+		controlPoints.push_back(vec3(x, y, 0));
+		AddKnot();
+		// the new segment and the one before it, whose end tangent now sees the new point
+		staleSegment = std::min(staleSegment, std::max(0, (int)controlPoints.size() - 3));
+		pointsAdded++;
+		dirty = true;
+	}
 
-	// create program for the GPU
-	gpuProgram.create(vertexSource, fragmentSource, "fragmentColor");
+	void AddPoint(float cX, float cY) override {
+		CatmullRom::AddPoint(cX, cY);
+		staleSegment = std::min(staleSegment, std::max(0, (int)controlPoints.size() - 3));
+	}
 
-	printf("\nUsage: \n");
-	printf("Mouse Left Button: Add control point to polyline\n");
-	printf("Key 'P': Camera pan -x\n");
-	printf("Key 'p': Camera pan +x\n");
-	printf("Key 'Z': Camera zoom in\n");
-	printf("Key 'z': Camera zoom out\n");
-	printf("Key 'b': Draw Bezier curve\n");
-	printf("Key 'l': Draw Lagrange curve\n");
-	printf("Key 'c': Draw CatmullRom spline\n");
-	printf("Key 'T': CatmullRom spline tension increase by 0.1\n");
-	printf("Key 't': CatmullRom spline tension decrease by 0.1\n");
-}
+	void Tessellate() override {
+		int numSegments = std::max(0, (int)controlPoints.size() - 1);
+		if (tension != tessellatedTension || ts.size() != controlPoints.size()) { staleSegment = 0; tessellatedTension = tension; }
+		if (dirtyPointLast >= 0) staleSegment = std::min(staleSegment, std::max(0, dirtyPointFirst - 2)); // dragged points
+		staleSegment = std::min(staleSegment, numSegments);
+		vertexData.resize((size_t)numSegments * (numSections + 1) * 2);
+		for (int i = staleSegment; i < numSegments; i++) EvaluateSegment(i);
+		profiler().count("samples evaluated", (numSegments - staleSegment) * (numSections + 1));
+		changedVertexFirst = compacted ? 0 : staleSegment * (numSections + 1);
+		changedVertexLast = INT_MAX;
+		compacted = false;
+		staleSegment = numSegments;
+	}
+};
 
-// Window has become invalid: Redraw
-void onDisplay() {
-	glClearColor(0, 0, 0, 0);							// background color 
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // clear the screen
+// Feeds points from another thread into a streaming curve through a lock-free queue.
+// The points come as "x y" lines in modeling space from the standard input when it is a pipe or a socket,
+// otherwise a generator produces a 10 kHz Lissajous figure for benchmarking.
+class PointIngestor {
+	SpscRing<vec2> queue;
+	std::thread producer;
+	std::atomic<bool> running{ false };
+	bool fromInput = false;
+
+	// the lines of the standard input, it is polled so that Stop does not wait for the next line
+	void ReadInput() {
+#if !defined(_WIN32)
+		char buffer[4096];
+		size_t used = 0;
+		struct pollfd input = { fileno(stdin), POLLIN, 0 };
+		while (running) {
+			if (poll(&input, 1, 50) <= 0) continue;
+			ssize_t bytes = read(input.fd, buffer + used, sizeof(buffer) - 1 - used);
+			if (bytes <= 0) break; // the end of the input
+			used += bytes;
+			buffer[used] = 0;
+			char* line = buffer;
+			for (char* end; (end = strchr(line, '\n')) != nullptr; line = end + 1) {
+				*end = 0;
+				vec2 point;
+				if (sscanf(line, "%f %f", &point.x, &point.y) == 2 && !queue.push(point)) dropped++;
+			}
+			used = buffer + used - line;
+			if (used == sizeof(buffer) - 1) used = 0; // a line too long to be a point
+			memmove(buffer, line, used);
+		}
+#endif
+	}
 
-	switch (currentCurve) {
-	case BEZIER: bezier.Draw(); break;
-	case LAGRANGE: lagrange.Draw(); break;
-	case CATMULLROM: catmullrom.Draw(); break;
-	case NONE: break;
+	void Generate() {
+		const int rate = 10000; // points per second
+		auto next = std::chrono::steady_clock::now();
+		for (long long k = 0; running; k++) {
+			float t = k / (float)rate;
+			if (!queue.push(vec2(10 * sinf(3 * t), 10 * sinf(4 * t + 0.5f)))) dropped++;
+			if (k % 10 == 9) std::this_thread::sleep_until(next += std::chrono::milliseconds(1)); // 10 points per msec
+		}
 	}
-	glutSwapBuffers();									// exchange the two buffers
-}
 
-// Key of ASCII code pressed
-void onKeyboard(unsigned char key, int pX, int pY) {
-	switch (key) {
-	case 'p': camera.Pan(vec2(-1, 0)); printf("Camera moved to the left 1 meter\n"); break;
-	case 'P': camera.Pan(vec2(+1, 0)); printf("Camera moved to the right 1 meter\n"); break;
+public:
+	std::atomic<unsigned long long> dropped{ 0 };	// the queue was full
+	StreamingCatmullRom* curve = nullptr;
+
+	PointIngestor() : queue(1 << 16) { }
+	~PointIngestor() { Stop(); }
+
+	bool IsRunning() const { return running; }
+
+	void Start(StreamingCatmullRom* _curve) {
+		Stop();
+		curve = _curve;
+		running = true;
+#if defined(_WIN32)
+		fromInput = false;
+#else
+		struct stat info;
+		fromInput = fstat(fileno(stdin), &info) == 0 && (S_ISFIFO(info.st_mode) || S_ISSOCK(info.st_mode));
+#endif
+		producer = std::thread([this]() { if (fromInput) ReadInput(); else Generate(); });
+		printf("Streaming points %s\n", fromInput ? "from the standard input" : "of the 10 kHz generator");
+	}
 
-	case 'Z': camera.Zoom(1.1f); printf("Zoomed out\n"); break;
-	case 'z': camera.Zoom(1/1.1); printf("Zoomed in\n"); break;
+	void Stop() {
+		running = false;
+		if (producer.joinable()) producer.join();
+		curve = nullptr;
+	}
 
-	case 'b': currentCurve = BEZIER;
+	// move the queued points into the curve, returns the number of points
+	int Drain() {
+		vec2 point;
+		int count = 0;
+		while (queue.pop(point)) {
+			if (curve) curve->AddModelPoint(point.x, point.y);
+			count++;
+		}
+		return count;
+	}
+};
+
+PointIngestor ingestor;
+
+// Least squares fitting of cubic Bezier pieces to a dense polyline within an error bound,
+// after P. J. Schneider: An algorithm for automatically fitting digitized curves (Graphics Gems, 1990).
+// The polyline is cut into chunks that are fitted on all cores, the pieces of neighboring chunks meet
+// at the shared sample with the same tangent, so the result is as smooth as a fit of the whole polyline.
+class CurveFitter {
+	const std::vector<vec2>& d;		// the samples
+	float tolerance;				// max distance of a sample from its point of the fitted piece
+
+	static vec2 Bezier3(const vec2* b, float u) {
+		float v = 1 - u;
+		return b[0] * (v * v * v) + b[1] * (3 * u * v * v) + b[2] * (3 * u * u * v) + b[3] * (u * u * u);
+	}
+
+	static vec2 Direction(vec2 v) { float l = length(v); return l > 0 ? v / l : vec2(0, 0); }
+
+	vec2 Tangent(int i, int first, int last) const { // unit direction of the polyline at sample i, towards the later samples
+		if (i == first) return Direction(d[first + 1] - d[first]);
+		if (i == last) return Direction(d[last] - d[last - 1]);
+		return Direction(d[i + 1] - d[i - 1]);
+	}
+
+	// the control points that best fit the samples at parameters u with given end tangents
+	void GenerateBezier(int first, int last, const std::vector<float>& u, vec2 tHat1, vec2 tHat2, vec2* b) const {
+		double c00 = 0, c01 = 0, c11 = 0, x0 = 0, x1 = 0;
+		vec2 p0 = d[first], p3 = d[last];
+		for (int i = 0; i <= last - first; i++) {
+			float t = u[i], v = 1 - t;
+			vec2 a1 = tHat1 * (3 * t * v * v), a2 = tHat2 * (3 * t * t * v);
+			c00 += dot(a1, a1); c01 += dot(a1, a2); c11 += dot(a2, a2);
+			vec2 tmp = d[first + i] - (p0 * (v * v * v + 3 * t * v * v) + p3 * (3 * t * t * v + t * t * t));
+			x0 += dot(a1, tmp); x1 += dot(a2, tmp);
+		}
+		double det = c00 * c11 - c01 * c01;
+		double alpha1 = det != 0 ? (x0 * c11 - x1 * c01) / det : 0;
+		double alpha2 = det != 0 ? (c00 * x1 - c01 * x0) / det : 0;
+		float segLength = length(p3 - p0), epsilon = 1e-6f * segLength;
+		if (alpha1 < epsilon || alpha2 < epsilon) alpha1 = alpha2 = segLength / 3; // Wu/Barsky heuristic
+		b[0] = p0; b[1] = p0 + tHat1 * (float)alpha1; b[2] = p3 + tHat2 * (float)alpha2; b[3] = p3;
+	}
+
+	// squared error of the worst sample and where it is
+	float MaxError(int first, int last, const vec2* b, const std::vector<float>& u, int& split) const {
+		float maxError = 0;
+		split = (first + last) / 2;
+		for (int i = 1; i < last - first; i++) {
+			vec2 diff = Bezier3(b, u[i]) - d[first + i];
+			float error = dot(diff, diff);
+			if (error >= maxError) { maxError = error; split = first + i; }
+		}
+		return maxError;
+	}
+
+	// a Newton-Raphson step towards the parameter of the closest point of the piece to each sample
+	void Reparameterize(int first, int last, const vec2* b, std::vector<float>& u) const {
+		vec2 q1[3] = { (b[1] - b[0]) * 3, (b[2] - b[1]) * 3, (b[3] - b[2]) * 3 };
+		vec2 q2[2] = { (q1[1] - q1[0]) * 2, (q1[2] - q1[1]) * 2 };
+		for (int i = 0; i <= last - first; i++) {
+			float t = u[i], v = 1 - t;
+			vec2 diff = Bezier3(b, t) - d[first + i];
+			vec2 first1 = q1[0] * (v * v) + q1[1] * (2 * t * v) + q1[2] * (t * t);
+			vec2 second = q2[0] * v + q2[1] * t;
+			float denominator = dot(first1, first1) + dot(diff, second);
+			if (denominator != 0) u[i] = std::min(1.0f, std::max(0.0f, t - dot(diff, first1) / denominator));
+		}
+	}
+
+	void FitCubic(int first, int last, vec2 tHat1, vec2 tHat2, std::vector<vec2>& out, float& maxDeviation) const {
+		vec2 b[4];
+		if (last - first == 1) { // two samples: a straight piece
+			float dist = length(d[last] - d[first]) / 3;
+			b[0] = d[first]; b[1] = d[first] + tHat1 * dist; b[2] = d[last] + tHat2 * dist; b[3] = d[last];
+			out.push_back(b[1]); out.push_back(b[2]); out.push_back(b[3]);
+			return;
+		}
+		std::vector<float> u(last - first + 1); // chord length parameterization
+		u[0] = 0;
+		for (int i = first + 1; i <= last; i++) u[i - first] = u[i - first - 1] + length(d[i] - d[i - 1]);
+		for (float& t : u) t /= u.back();
+
+		float error2 = tolerance * tolerance;
+		int split;
+		for (int iteration = 0; ; iteration++) {
+			GenerateBezier(first, last, u, tHat1, tHat2, b);
+			float maxError = MaxError(first, last, b, u, split);
+			if (maxError < error2) {
+				out.push_back(b[1]); out.push_back(b[2]); out.push_back(b[3]);
+				maxDeviation = std::max(maxDeviation, sqrtf(maxError));
+				return;
+			}
+			if (maxError > error2 * 4 || iteration == 4) break; // too far for reparameterization to help
+			Reparameterize(first, last, b, u);
+		}
+		vec2 tHatCenter = Tangent(split, first, last);
+		FitCubic(first, split, tHat1, -tHatCenter, out, maxDeviation);
+		FitCubic(split, last, tHatCenter, tHat2, out, maxDeviation);
+	}
+
+public:
+	static const int chunkSize = 4096; // samples fitted by one task
+
+	CurveFitter(const std::vector<vec2>& samples, float _tolerance) : d(samples), tolerance(_tolerance) { }
+
+	float maxDeviation = 0;		// of the samples from the fitted curve, at most the tolerance
+
+	// control points of the pieces, 3k+1 of them for k pieces
+	std::vector<vec2> Fit() {
+		std::vector<vec2> result;
+		int n = (int)d.size();
+		if (n < 2) return result;
+		int numChunks = (n - 2) / chunkSize + 1;
+		std::vector<std::vector<vec2>> pieces(numChunks);
+		std::vector<float> deviations(numChunks, 0);
+		std::atomic<int> nextChunk{ 0 };
+		auto work = [&]() {
+			for (int c; (c = nextChunk++) < numChunks; ) {
+				int first = c * chunkSize, last = std::min(n - 1, first + chunkSize);
+				// the tangents at the ends of the chunk come from the whole polyline, so neighbors agree
+				FitCubic(first, last, Tangent(first, 0, n - 1), -Tangent(last, 0, n - 1), pieces[c], deviations[c]);
+			}
+		};
+		int numThreads = std::max(1, std::min((int)std::thread::hardware_concurrency(), numChunks));
+		std::vector<std::thread> threads;
+		for (int i = 1; i < numThreads; i++) threads.push_back(std::thread(work));
+		work();
+		for (auto& thread : threads) thread.join();
+
+		result.push_back(d[0]);
+		for (int c = 0; c < numChunks; c++) {
+			result.insert(result.end(), pieces[c].begin(), pieces[c].end());
+			maxDeviation = std::max(maxDeviation, deviations[c]);
+		}
+		return result;
+	}
+};
+
+// Replaces a curve with cubic pieces fitted to its control points taken as a dense polyline
+PiecewiseBezier* FitCurve(const Curve* curve, float tolerance) {
+	std::vector<vec2> samples;
+	const float* xs = curve->controlPoints.xs();
+	const float* ys = curve->controlPoints.ys();
+	for (size_t i = 0; i < curve->controlPoints.size(); i++) // repeated samples would have no tangent
+		if (samples.empty() || samples.back().x != xs[i] || samples.back().y != ys[i]) samples.push_back(vec2(xs[i], ys[i]));
+	CurveFitter fitter(samples, tolerance);
+	std::vector<vec2> controlPoints = fitter.Fit();
+	PiecewiseBezier* fitted = new PiecewiseBezier();
+	fitted->wTranslate = curve->wTranslate;
+	fitted->controlPoints.reserve(controlPoints.size());
+	for (size_t i = 0; i < controlPoints.size(); i++) {
+		fitted->controlPoints.push_back(vec3(controlPoints[i].x, controlPoints[i].y, 0));
+		fitted->ts.push_back(i / 3.0f);
+	}
+	printf("Fitted %d samples with %d pieces (%d control points): compression %.1f:1, max deviation %g\n",
+		(int)samples.size(), fitted->NumPieces(), (int)controlPoints.size(),
+		controlPoints.empty() ? 0.0 : (double)curve->controlPoints.size() / controlPoints.size(), fitter.maxDeviation);
+	return fitted;
+}
+
+// Where two curves cross, a curve crosses itself, or a curve crosses a line
+struct Intersection {
+	float t1, t2;	// parameter on the first curve, and on the second curve or along the line
+	vec2 point;		// in world space
+};
+
+// Finds the intersections of curves by sampling them into polylines with a hierarchy of bounding boxes over
+// runs of consecutive segments. Pairs of boxes are subdivided together and only the overlapping pairs are
+// descended, so a query costs about as much as the segments near the crossings instead of all pairs of segments.
+// The crossings of the segments are refined with Newton steps on the curves themselves. Tangled polylines,
+// whose boxes overlap so much that the culling does not pay off, fall back to a sweep over the segments sorted by x.
+class CurveIntersector {
+public:
+	struct Box {
+		vec2 lo = vec2(1e30f, 1e30f), hi = vec2(-1e30f, -1e30f);
+		void Extend(vec2 p) { lo = vec2(fminf(lo.x, p.x), fminf(lo.y, p.y)); hi = vec2(fmaxf(hi.x, p.x), fmaxf(hi.y, p.y)); }
+		void Extend(const Box& b) { Extend(b.lo); Extend(b.hi); }
+		bool Overlaps(const Box& b) const { return lo.x <= b.hi.x && b.lo.x <= hi.x && lo.y <= b.hi.y && b.lo.y <= hi.y; }
+	};
+
+	struct Polyline {
+		Curve* curve = nullptr;
+		std::vector<vec2> points;	// samples in world space
+		std::vector<float> ts;		// their parameters
+		std::vector<std::vector<Box>> levels; // levels[0] bounds leafSize segments each, levels[l] two boxes of levels[l - 1]
+		bool closed = false;		// the last sample is the first one, so the first and the last segments are neighbors too
+		int NumSegments() const { return std::max(0, (int)points.size() - 1); }
+	};
+
+	static const int leafSize = 8;		// segments bounded by a leaf box
+	static constexpr int minSegments = 64;	// samples of a curve with a coarse tessellation
+
+	int segmentTests = 0;	// of the last query
+	bool usedSweep = false;	// the last query fell back to the sweep
+
+	// sample the curve as finely as it is tessellated
+	Polyline Sample(Curve* curve) {
+		Polyline line;
+		line.curve = curve;
+		float tStart, tEnd;
+		curve->ParameterRange(tStart, tEnd);
+		if (curve->controlPoints.size() < 2 || !(tEnd > tStart)) return line;
+		int numSegments = std::max(minSegments, std::min(Curve::maxStripVertices, (int)curve->vertexData.size() / 2));
+		line.points.resize(numSegments + 1);
+		line.ts.resize(numSegments + 1);
+		// r(t) only reads the curve, so chunks of samples are evaluated on all cores
+		const int chunkSize = 16384;
+		int numChunks = numSegments / chunkSize + 1;
+		std::atomic<int> nextChunk{ 0 };
+		auto work = [&]() {
+			for (int c; (c = nextChunk++) < numChunks; ) {
+				for (int i = c * chunkSize; i <= std::min(numSegments, (c + 1) * chunkSize - 1); i++) {
+					float t = (i == numSegments) ? tEnd : tStart + (tEnd - tStart) * ((float)i / numSegments);
+					vec3 p = curve->r(t);
+					line.points[i] = vec2(p.x + curve->wTranslate.x, p.y + curve->wTranslate.y);
+					line.ts[i] = t;
+				}
+			}
+		};
+		int numThreads = std::max(1, std::min((int)std::thread::hardware_concurrency(), numChunks));
+		std::vector<std::thread> threads;
+		for (int i = 1; i < numThreads; i++) threads.push_back(std::thread(work));
+		work();
+		for (auto& thread : threads) thread.join();
+		profiler().count("samples evaluated", numSegments + 1);
+		vec2 gap = line.points[numSegments] - line.points[0];
+		line.closed = numSegments >= 3 && length(gap) <= 1e-4f * (length(line.points[1] - line.points[0]) + length(line.points[numSegments] - line.points[numSegments - 1]));
+
+		int numLeaves = (numSegments + leafSize - 1) / leafSize;
+		line.levels.push_back(std::vector<Box>(numLeaves));
+		for (int k = 0; k < numLeaves; k++)
+			for (int i = k * leafSize; i <= std::min(numSegments, (k + 1) * leafSize); i++) line.levels[0][k].Extend(line.points[i]);
+		while (line.levels.back().size() > 1) {
+			const std::vector<Box>& below = line.levels.back();
+			std::vector<Box> level((below.size() + 1) / 2);
+			for (size_t i = 0; i < below.size(); i++) level[i / 2].Extend(below[i]);
+			line.levels.push_back(level);
+		}
+		return line;
+	}
+
+	// crossings of two polylines, or of a polyline with itself if they are the same
+	std::vector<Intersection> Intersect(const Polyline& a, const Polyline& b) {
+		std::vector<Intersection> result;
+		segmentTests = 0;
+		usedSweep = false;
+		if (a.levels.empty() || b.levels.empty()) return result;
+		bool self = &a == &b;
+		// more tests than this means that the boxes hardly cull anything
+		long long budget = 16LL * leafSize * (a.NumSegments() + b.NumSegments()) + 4096;
+		struct Node { int levelA, indexA, levelB, indexB; };
+		std::vector<Node> stack;
+		stack.push_back({ (int)a.levels.size() - 1, 0, (int)b.levels.size() - 1, 0 });
+		while (!stack.empty()) {
+			Node node = stack.back();
+			stack.pop_back();
+			if (!a.levels[node.levelA][node.indexA].Overlaps(b.levels[node.levelB][node.indexB])) continue;
+			if (node.levelA == 0 && node.levelB == 0) {
+				IntersectLeaves(a, node.indexA, b, node.indexB, self, result);
+				if (segmentTests > budget) return Sweep(a, b);
+				continue;
+			}
+			if (self && node.levelA == node.levelB && node.indexA == node.indexB) { // a box with itself: its halves with themselves and each other
+				int level = node.levelA - 1, first = 2 * node.indexA, numBoxes = (int)a.levels[level].size();
+				stack.push_back({ level, first, level, first });
+				if (first + 1 < numBoxes) {
+					stack.push_back({ level, first + 1, level, first + 1 });
+					stack.push_back({ level, first, level, first + 1 });
+				}
+				continue;
+			}
+			if (node.levelA >= node.levelB && node.levelA > 0) { // split the bigger box
+				int level = node.levelA - 1;
+				for (int i = 2 * node.indexA; i <= 2 * node.indexA + 1 && i < (int)a.levels[level].size(); i++)
+					stack.push_back({ level, i, node.levelB, node.indexB });
+			}
+			else {
+				int level = node.levelB - 1;
+				for (int i = 2 * node.indexB; i <= 2 * node.indexB + 1 && i < (int)b.levels[level].size(); i++)
+					stack.push_back({ node.levelA, node.indexA, level, i });
+			}
+		}
+		return result;
+	}
+
+	// crossings of a polyline with the infinite line through p and q, t2 is 0 at p and 1 at q
+	std::vector<Intersection> IntersectLine(const Polyline& a, vec2 p, vec2 q) {
+		std::vector<Intersection> result;
+		segmentTests = 0;
+		usedSweep = false;
+		if (a.levels.empty()) return result;
+		vec2 d = q - p;
+		auto side = [&](vec2 point) { return d.x * (point.y - p.y) - d.y * (point.x - p.x); };
+		std::vector<std::pair<int, int>> stack; // level, index
+		stack.push_back(std::make_pair((int)a.levels.size() - 1, 0));
+		while (!stack.empty()) {
+			int level = stack.back().first, index = stack.back().second;
+			stack.pop_back();
+			const Box& box = a.levels[level][index];
+			float s0 = side(box.lo), s1 = side(box.hi), s2 = side(vec2(box.lo.x, box.hi.y)), s3 = side(vec2(box.hi.x, box.lo.y));
+			if (fminf(fminf(s0, s1), fminf(s2, s3)) > 0 || fmaxf(fmaxf(s0, s1), fmaxf(s2, s3)) < 0) continue; // all corners on one side
+			if (level > 0) {
+				for (int i = 2 * index; i <= 2 * index + 1 && i < (int)a.levels[level - 1].size(); i++) stack.push_back(std::make_pair(level - 1, i));
+				continue;
+			}
+			int last = std::min(a.NumSegments(), (index + 1) * leafSize);
+			for (int i = index * leafSize; i < last; i++) {
+				segmentTests++;
+				float u, v;
+				if (!CrossSegments(a.points[i], a.points[i + 1], p, q, i + 1 == a.NumSegments(), true, u, v)) continue;
+				Intersection hit;
+				hit.t1 = a.ts[i] + (a.ts[i + 1] - a.ts[i]) * u;
+				hit.t2 = v;
+				RefineOnLine(a, i, p, q, hit);
+				result.push_back(hit);
+			}
+		}
+		return result;
+	}
+
+private:
+	// the segments p0-p1 and q0-q1 cross at p0 + (p1 - p0) u = q0 + (q1 - q0) v. Ranges are half open, so a crossing
+	// at a shared sample is found once, unless the segment is the last one. A line has unbounded v.
+	static bool CrossSegments(vec2 p0, vec2 p1, vec2 q0, vec2 q1, bool lastP, bool lineQ, float& u, float& v, bool lastQ = false) {
+		vec2 dp = p1 - p0, dq = q1 - q0, w = q0 - p0;
+		float denominator = dp.x * dq.y - dp.y * dq.x;
+		if (fabsf(denominator) <= 1e-6f * length(dp) * length(dq)) return false; // parallel up to rounding, overlaps are not reported
+		u = (w.x * dq.y - w.y * dq.x) / denominator;
+		v = (w.x * dp.y - w.y * dp.x) / denominator;
+		if (!(u >= 0 && (u < 1 || (lastP && u <= 1)))) return false;
+		return lineQ || (v >= 0 && (v < 1 || (lastQ && v <= 1)));
+	}
+
+	// segments i < j of a polyline that share a sample, which is not a crossing
+	static bool Neighbors(const Polyline& line, int i, int j) { return j - i < 2 || (line.closed && i == 0 && j == line.NumSegments() - 1); }
+
+	void IntersectLeaves(const Polyline& a, int leafA, const Polyline& b, int leafB, bool self, std::vector<Intersection>& result) {
+		int lastA = std::min(a.NumSegments(), (leafA + 1) * leafSize), lastB = std::min(b.NumSegments(), (leafB + 1) * leafSize);
+		for (int i = leafA * leafSize; i < lastA; i++) {
+			for (int j = (self && leafA == leafB) ? i + 2 : leafB * leafSize; j < lastB; j++) {
+				if (self && Neighbors(a, std::min(i, j), std::max(i, j))) continue;
+				segmentTests++;
+				TestSegments(a, i, b, j, result);
+			}
+		}
+	}
+
+	void TestSegments(const Polyline& a, int i, const Polyline& b, int j, std::vector<Intersection>& result) {
+		float u, v;
+		if (!CrossSegments(a.points[i], a.points[i + 1], b.points[j], b.points[j + 1], i + 1 == a.NumSegments(), false, u, v, j + 1 == b.NumSegments()))
+			return;
+		Intersection hit;
+		hit.t1 = a.ts[i] + (a.ts[i + 1] - a.ts[i]) * u;
+		hit.t2 = b.ts[j] + (b.ts[j + 1] - b.ts[j]) * v;
+		Refine(a, i, b, j, hit);
+		result.push_back(hit);
+	}
+
+	static vec2 Evaluate(const Polyline& line, float t) {
+		vec3 p = line.curve->r(t);
+		return vec2(p.x + line.curve->wTranslate.x, p.y + line.curve->wTranslate.y);
+	}
+
+	// Newton steps on r1(t1) - r2(t2) = 0 starting from the crossing of the segments, kept if they stay
+	// near the segments and get closer, otherwise the crossing of the segments is good enough
+	static void Refine(const Polyline& a, int i, const Polyline& b, int j, Intersection& hit) {
+		float ha = (a.ts[i + 1] - a.ts[i]) * 1e-2f, hb = (b.ts[j + 1] - b.ts[j]) * 1e-2f;
+		float t1 = hit.t1, t2 = hit.t2;
+		vec2 f = Evaluate(a, t1) - Evaluate(b, t2);
+		float error = length(f);
+		for (int iteration = 0; iteration < 4 && error > 0; iteration++) {
+			vec2 da = (Evaluate(a, t1 + ha) - Evaluate(a, t1 - ha)) / (2 * ha);
+			vec2 db = (Evaluate(b, t2 + hb) - Evaluate(b, t2 - hb)) / (2 * hb);
+			float det = -da.x * db.y + da.y * db.x; // of the Jacobian [da, -db]
+			if (det == 0) break;
+			float n1 = t1 - (-f.x * db.y + f.y * db.x) / det;
+			float n2 = t2 - (da.x * f.y - da.y * f.x) / det;
+			if (fabsf(n1 - hit.t1) > 100 * ha || fabsf(n2 - hit.t2) > 100 * hb) break; // left the segments
+			vec2 nf = Evaluate(a, n1) - Evaluate(b, n2);
+			if (!(length(nf) < error)) break;
+			t1 = n1; t2 = n2; f = nf; error = length(nf);
+		}
+		hit.t1 = t1; hit.t2 = t2;
+		hit.point = Evaluate(a, t1);
+	}
+
+	static void RefineOnLine(const Polyline& a, int i, vec2 p, vec2 q, Intersection& hit) {
+		vec2 d = q - p;
+		float lengthSquared = dot(d, d), h = (a.ts[i + 1] - a.ts[i]) * 1e-2f, t = hit.t1;
+		auto side = [&](float t) { vec2 point = Evaluate(a, t); return (d.x * (point.y - p.y) - d.y * (point.x - p.x)); };
+		float s = side(t);
+		for (int iteration = 0; iteration < 4 && s != 0; iteration++) {
+			float slope = (side(t + h) - side(t - h)) / (2 * h);
+			if (slope == 0) break;
+			float next = t - s / slope;
+			if (fabsf(next - hit.t1) > 100 * h) break;
+			float ns = side(next);
+			if (!(fabsf(ns) < fabsf(s))) break;
+			t = next; s = ns;
+		}
+		hit.t1 = t;
+		hit.point = Evaluate(a, t);
+		hit.t2 = lengthSquared > 0 ? dot(hit.point - p, d) / lengthSquared : 0;
+	}
+
+	// sweep a vertical line over the segments sorted by their left end, testing each against the active ones it overlaps in y
+	std::vector<Intersection> Sweep(const Polyline& a, const Polyline& b) {
+		std::vector<Intersection> result;
+		segmentTests = 0;
+		usedSweep = true;
+		bool self = &a == &b;
+		struct Segment { float xMin, xMax, yMin, yMax; int index; bool fromB; };
+		std::vector<Segment> segments;
+		auto add = [&](const Polyline& line, bool fromB) {
+			for (int i = 0; i < line.NumSegments(); i++) {
+				vec2 p0 = line.points[i], p1 = line.points[i + 1];
+				segments.push_back({ fminf(p0.x, p1.x), fmaxf(p0.x, p1.x), fminf(p0.y, p1.y), fmaxf(p0.y, p1.y), i, fromB });
+			}
+		};
+		add(a, false);
+		if (!self) add(b, true);
+		std::sort(segments.begin(), segments.end(), [](const Segment& s0, const Segment& s1) { return s0.xMin < s1.xMin; });
+		std::vector<Segment> active;
+		for (const Segment& segment : segments) {
+			for (size_t k = 0; k < active.size(); ) { // drop the segments left of the sweep line
+				if (active[k].xMax < segment.xMin) { active[k] = active.back(); active.pop_back(); }
+				else k++;
+			}
+			for (const Segment& other : active) {
+				if (other.yMax < segment.yMin || segment.yMax < other.yMin) continue;
+				if (self) {
+					int i = std::min(other.index, segment.index), j = std::max(other.index, segment.index);
+					if (Neighbors(a, i, j)) continue;
+					segmentTests++;
+					TestSegments(a, i, a, j, result);
+				}
+				else if (other.fromB != segment.fromB) {
+					segmentTests++;
+					if (segment.fromB) TestSegments(a, other.index, b, segment.index, result);
+					else TestSegments(a, segment.index, b, other.index, result);
+				}
+			}
+			active.push_back(segment);
+		}
+		return result;
+	}
+};
+
+enum PointState { POINT_NORMAL = 0, POINT_HOVERED = 1, POINT_SELECTED = 2, POINT_MARKER = 3, POINT_CLUSTER = 4 };
+
+// Draws the control points of every curve as instanced quads.
+// The positions live in their own position-only buffer that is written only where a point moved,
+// and the highlight of a point is a one byte instance attribute in a separate buffer.
+class ControlPointRenderer {
+	GLVertexArray vao;
+	GLBuffer cornerVbo, positionVbo, stateVbo;
+	int numPoints = 0;
+	UniformHandle mvpUniform, pointSizeUniform;
+public:
+	std::vector<vec2>			positions;	// world space position of every control point
+	std::vector<unsigned char>	states;		// PointState of every control point
+
+	void create() {
+		mvpUniform = pointProgram.getUniform("MVP");
+		pointSizeUniform = pointProgram.getUniform("pointSize");
+
+		vao.create();
+		vao.bind();
+
+		// the unit quad drawn as a triangle strip for every instance
+		float corners[] = { -1, -1,  1, -1,  -1, 1,  1, 1 };
+		cornerVbo.upload(corners, sizeof(corners), GL_ARRAY_BUFFER, GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+
+		positionVbo.create();
+		positionVbo.bind();
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vec2), nullptr);
+		glVertexAttribDivisor(1, 1); // one position per instance
+
+		stateVbo.create();
+		stateVbo.bind();
+		glEnableVertexAttribArray(2);
+		glVertexAttribIPointer(2, 1, GL_UNSIGNED_BYTE, 1, nullptr);
+		glVertexAttribDivisor(2, 1); // one state per instance
+	}
+
+	// upload every position and state, after points were added or removed
+	void Upload() {
+		numPoints = (int)positions.size();
+		if (numPoints == 0) return;
+		positionVbo.upload(&positions[0], numPoints * sizeof(vec2));
+		stateVbo.upload(&states[0], numPoints);
+	}
+
+	// upload the points from the first on, after points were added or removed at the end,
+	// everything if the buffers have no room for them
+	void UploadFrom(int first) {
+		numPoints = (int)positions.size();
+		if ((size_t)numPoints * sizeof(vec2) > positionVbo.getCapacity() || (size_t)numPoints > stateVbo.getCapacity()) { Upload(); return; }
+		int count = numPoints - first;
+		if (count <= 0) return;
+		UploadPositions(first, count);
+		stateVbo.bind();
+		glBufferSubData(GL_ARRAY_BUFFER, first, count, &states[first]);
+		profiler().count("bytes uploaded", count);
+	}
+
+	void UploadPositions(int first, int count) {
+		positionVbo.bind();
+		glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(vec2), count * sizeof(vec2), &positions[first]);
+		profiler().count("bytes uploaded", count * sizeof(vec2));
+	}
+
+	void SetState(int i, PointState state) {
+		if (states[i] == state) return;
+		states[i] = (unsigned char)state;
+		stateVbo.bind();
+		glBufferSubData(GL_ARRAY_BUFFER, i, 1, &states[i]);
+		profiler().count("bytes uploaded", 1);
+	}
+
+	void Draw(const mat4& MVPTransform) {
+		if (numPoints == 0) return;
+		pointProgram.Use();
+		pointProgram.setUniform(MVPTransform, mvpUniform);
+		pointProgram.setUniform(vec2(10.0f / windowWidth, 10.0f / windowHeight), pointSizeUniform); // 10 pixel wide squares
+		vao.bind();
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, numPoints);
+	}
+};
+
+// Aggregates the control points for zoomed out views, where thousands of them would be drawn over the same pixels.
+// A quadtree of square cells: the cells of level L are 2^L times as wide as the finest ones, and every occupied cell
+// knows the number and the sum of the positions of its points, so it is drawn as one point at their centroid.
+// The levels are kept in hash maps of their occupied cells. A level is built from every point the first time it is
+// drawn, after that it follows the points one by one as they are added, moved or removed.
+class PointClusters {
+	struct Cell { int count = 0; double x = 0, y = 0; };
+	struct Level {
+		bool built = false;
+		std::unordered_map<unsigned long long, Cell> cells;
+	};
+	static const int numLevels = 24;
+	Level levels[numLevels];
+	int numBuilt = 0;
+
+	static constexpr float finestCell = 1.0f / 64;	// world units, 1/32 of a control point at the initial zoom
+
+	static unsigned long long Key(vec2 p, float cellSize) {
+		long long ix = (long long)floorf(fmaxf(-2e9f, fminf(2e9f, p.x / cellSize)));
+		long long iy = (long long)floorf(fmaxf(-2e9f, fminf(2e9f, p.y / cellSize)));
+		return ((unsigned long long)(unsigned int)ix << 32) | (unsigned int)iy;
+	}
+
+	void Add(Level& level, float cellSize, vec2 p, int sign) {
+		auto cell = level.cells.find(Key(p, cellSize));
+		if (cell == level.cells.end()) cell = level.cells.emplace(Key(p, cellSize), Cell()).first;
+		cell->second.count += sign;
+		cell->second.x += sign * (double)p.x;
+		cell->second.y += sign * (double)p.y;
+		if (cell->second.count == 0) level.cells.erase(cell);
+	}
+
+	void Add(vec2 p, int sign) {
+		if (numBuilt == 0) return;
+		float cellSize = finestCell;
+		for (Level& level : levels) {
+			if (level.built) Add(level, cellSize, p, sign);
+			cellSize *= 2;
+		}
+	}
+
+public:
+	// the finest level whose cells are at least as wide as a point drawn wPointSize wide, -1 if every cell is smaller
+	static int LevelFor(float wPointSize) {
+		float cellSize = finestCell;
+		for (int level = 0; level < numLevels; level++, cellSize *= 2)
+			if (cellSize >= wPointSize) return level;
+		return -1;
+	}
+
+	void Insert(vec2 p) { Add(p, +1); }
+	void Remove(vec2 p) { Add(p, -1); }
+	void Move(vec2 from, vec2 to) {
+		if (from.x == to.x && from.y == to.y) return;
+		Add(from, -1);
+		Add(to, +1);
+	}
+
+	// build the level from the positions unless it follows them already, returns the number of its occupied cells
+	size_t Build(int level, const std::vector<vec2>& positions) {
+		Level& built = levels[level];
+		if (!built.built) {
+			float cellSize = finestCell * (float)(1 << level);
+			built.cells.reserve(positions.size() / 4);
+			for (vec2 p : positions) Add(built, cellSize, p, +1);
+			built.built = true;
+			numBuilt++;
+		}
+		return built.cells.size();
+	}
+
+	// one instance per occupied cell of a built level, a lone point keeps the normal state
+	void Instances(int level, std::vector<vec2>& positions, std::vector<unsigned char>& states) const {
+		positions.clear();
+		states.clear();
+		for (auto& cell : levels[level].cells) {
+			const Cell& c = cell.second;
+			positions.push_back(vec2((float)(c.x / c.count), (float)(c.y / c.count)));
+			int magnitude = 0;
+			while (magnitude < 16 && (c.count >> (magnitude + 1)) > 0) magnitude++;	// floor(log2(count))
+			states.push_back((unsigned char)(c.count == 1 ? POINT_NORMAL : POINT_CLUSTER + magnitude - 1));
+		}
+	}
+};
+
+// Formats of the curve vertices in the shared vertex buffer
+enum VertexLayout {
+	LAYOUT_INTERLEAVED,	// x, y, r, g, b floats, 20 bytes
+	LAYOUT_POSITION,	// x, y floats with the color as a uniform, 8 bytes
+	LAYOUT_QUANTIZED,	// x, y 16-bit fractions of the scene bounding box, decoded in the vertex shader, 4 bytes
+};
+
+enum LineJoin { JOIN_ROUND = 0, JOIN_MITER = 1 };
+enum LineCap { CAP_ROUND = 0, CAP_BUTT = 1, CAP_SQUARE = 2 };
+
+// Draws the strips of the shared vertex buffer as lines of any width, which core profiles need not support with glLineWidth.
+// Every segment is an instance of a screen aligned quad, whose vertex shader reads the ends of the segment and their
+// neighbors from the vertex buffer itself through a buffer texture, so nothing is expanded or copied on the CPU.
+// Joins and caps are shaped by the shaders from one flag byte per vertex that marks the ends of the strips.
+class WideLineRenderer {
+	enum { FIRST_OF_STRIP = 1, LAST_OF_STRIP = 2 };
+
+	GLVertexArray vao;		// no attributes, the shader works from gl_VertexID and gl_InstanceID
+	GLBuffer flagsVbo;
+	unsigned int stripTexture = 0, flagsTexture = 0;	// buffer textures over the vertex buffer and the flags
+	int numVertices = 0, texelsPerVertex = 1, maxTexels = 0;
+	std::vector<unsigned char> flags;
+	UniformHandle mvpUniform, positionDecodeUniform, curveColorUniform, perVertexColorUniform, texelsPerVertexUniform,
+		stripsUniform, stripFlagsUniform, viewportSizeUniform, halfWidthUniform, lineJoinUniform, lineCapUniform, miterLimitUniform;
+
+	static const int stripUnit = 1, flagsUnit = 2;	// texture units, 0 is left to the images
+
+public:
+	float width = 2;		// in pixels
+	LineJoin join = JOIN_ROUND;
+	LineCap cap = CAP_ROUND;
+	float miterLimit = 4;	// in half widths
+
+	void create() {
+		mvpUniform = wideLineProgram.getUniform("MVP");
+		positionDecodeUniform = wideLineProgram.getUniform("positionDecode");
+		curveColorUniform = wideLineProgram.getUniform("curveColor");
+		perVertexColorUniform = wideLineProgram.getUniform("perVertexColor");
+		texelsPerVertexUniform = wideLineProgram.getUniform("texelsPerVertex");
+		stripsUniform = wideLineProgram.getUniform("strips");
+		stripFlagsUniform = wideLineProgram.getUniform("stripFlags");
+		viewportSizeUniform = wideLineProgram.getUniform("viewportSize");
+		halfWidthUniform = wideLineProgram.getUniform("halfWidth");
+		lineJoinUniform = wideLineProgram.getUniform("lineJoin");
+		lineCapUniform = wideLineProgram.getUniform("lineCap");
+		miterLimitUniform = wideLineProgram.getUniform("miterLimit");
+
+		vao.create();
+		flagsVbo.create();
+		glGenTextures(1, &stripTexture);
+		glGenTextures(1, &flagsTexture);
+		glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+	}
+
+	// after a relayout: the strips of vbo in the layout are vertices firsts[k] .. firsts[k] + counts[k] - 1
+	void SetStrips(GLBuffer& vbo, VertexLayout layout, int _numVertices, const std::vector<int>& firsts, const std::vector<int>& counts) {
+		numVertices = _numVertices;
+		flags.assign(numVertices, 0);
+		for (size_t k = 0; k < firsts.size(); k++) {
+			flags[firsts[k]] |= FIRST_OF_STRIP;
+			flags[firsts[k] + counts[k] - 1] |= LAST_OF_STRIP;
+		}
+		if (numVertices > 0) flagsVbo.upload(&flags[0], numVertices, GL_TEXTURE_BUFFER);
+		GLenum format = GL_RG32F;
+		texelsPerVertex = 1;
+		switch (layout) {
+		case LAYOUT_INTERLEAVED: format = GL_R32F; texelsPerVertex = 5; break;
+		case LAYOUT_POSITION: format = GL_RG32F; break;
+		case LAYOUT_QUANTIZED: format = GL_RG16; break;	// normalized, the shader reads [0,1]
+		}
+		// the buffer textures follow the buffers when their storage is reallocated, they are attached only once a layout
+		glState().bindTextureBuffer(stripUnit, stripTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, format, vbo.getId());
+		glState().bindTextureBuffer(flagsUnit, flagsTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R8UI, flagsVbo.getId());
+	}
+
+	// the last strip, which starts at vertex first, now has count vertices instead of oldCount, the others stay where
+	// they are. False if the flags buffer has no room for it, nothing is uploaded until UploadFlags.
+	bool ResizeLastStrip(int first, int oldCount, int count) {
+		if ((size_t)(first + count) > flagsVbo.getCapacity()) return false;
+		if (oldCount > 0) flags[first + oldCount - 1] &= ~LAST_OF_STRIP;
+		numVertices = first + count;
+		flags.resize(numVertices, 0);
+		if (count > 0) {
+			flags[first] |= FIRST_OF_STRIP;
+			flags[first + count - 1] |= LAST_OF_STRIP;
+		}
+		return true;
+	}
+
+	void UploadFlags(int first) { // of the vertices from the first on
+		if (first >= numVertices) return;
+		flagsVbo.bind(GL_TEXTURE_BUFFER);
+		glBufferSubData(GL_TEXTURE_BUFFER, first, numVertices - first, &flags[first]);
+		profiler().count("bytes uploaded", numVertices - first);
+	}
+
+	// false if the strips do not fit into a buffer texture, then they must be drawn otherwise
+	bool Draw(const mat4& MVPTransform, const vec4& positionDecode, bool perVertexColor, const vec3& color) {
+		if ((long long)numVertices * texelsPerVertex > maxTexels) return false;
+		if (numVertices < 2) return true;
+		wideLineProgram.Use();
+		wideLineProgram.setUniform(MVPTransform, mvpUniform);
+		wideLineProgram.setUniform(positionDecode, positionDecodeUniform);
+		wideLineProgram.setUniform(perVertexColor ? 1 : 0, perVertexColorUniform);
+		wideLineProgram.setUniform(color, curveColorUniform);
+		wideLineProgram.setUniform(texelsPerVertex, texelsPerVertexUniform);
+		wideLineProgram.setUniform(vec2((float)windowWidth, (float)windowHeight), viewportSizeUniform);
+		wideLineProgram.setUniform(width / 2, halfWidthUniform);
+		wideLineProgram.setUniform((int)join, lineJoinUniform);
+		wideLineProgram.setUniform((int)cap, lineCapUniform);
+		wideLineProgram.setUniform(miterLimit, miterLimitUniform);
+		glState().bindTextureBuffer(stripUnit, stripTexture);
+		wideLineProgram.setUniform(stripUnit, stripsUniform);
+		glState().bindTextureBuffer(flagsUnit, flagsTexture);
+		wideLineProgram.setUniform(flagsUnit, stripFlagsUniform);
+		vao.bind();
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, numVertices - 1);	// the segments between strips are clipped away
+		return true;
+	}
+
+	~WideLineRenderer() {
+		for (unsigned int* texture : { &stripTexture, &flagsTexture }) {
+			if (*texture == 0) continue;
+			glState().forgetTexture(*texture);
+			glDeleteTextures(1, texture);
+		}
+	}
+};
+
+// Douglas-Peucker: the vertices of the x, y pairs of xy that the polyline needs to stay within tolerance of the original,
+// the first and the last are always kept. A run between two kept vertices is split at its vertex farthest from the
+// segment between them until no vertex of any run is farther than the tolerance.
+void SimplifyPolyline(const float* xy, int count, float tolerance, std::vector<float>& out) {
+	out.clear();
+	if (count <= 2) { out.assign(xy, xy + count * 2); return; }
+	FrameVector<unsigned char> keep(count, 0);
+	FrameVector<std::pair<int, int>> runs;	// still to be split, instead of recursion
+	keep[0] = keep[count - 1] = 1;
+	runs.push_back(std::make_pair(0, count - 1));
+	float tolerance2 = tolerance * tolerance;
+	while (!runs.empty()) {
+		int first = runs.back().first, last = runs.back().second;
+		runs.pop_back();
+		vec2 a(xy[first * 2], xy[first * 2 + 1]), ab = vec2(xy[last * 2], xy[last * 2 + 1]) - a;
+		float ab2 = dot(ab, ab), farthest2 = tolerance2;
+		int split = -1;
+		for (int i = first + 1; i < last; i++) {
+			vec2 ap = vec2(xy[i * 2], xy[i * 2 + 1]) - a;
+			float u = ab2 > 0 ? fminf(fmaxf(dot(ap, ab) / ab2, 0), 1) : 0;	// to the segment, strips may turn back
+			vec2 d = ap - ab * u;
+			if (dot(d, d) > farthest2) { farthest2 = dot(d, d); split = i; }
+		}
+		if (split < 0) continue;
+		keep[split] = 1;
+		if (split - first > 1) runs.push_back(std::make_pair(first, split));
+		if (last - split > 1) runs.push_back(std::make_pair(split, last));
+	}
+	for (int i = 0; i < count; i++) {
+		if (!keep[i]) continue;
+		out.push_back(xy[i * 2]);
+		out.push_back(xy[i * 2 + 1]);
+	}
+}
+
+// Holds every curve of the session and draws them from shared vertex buffers.
+// The tessellated strips are packed one after the other into one buffer and drawn as wide lines by one instanced
+// draw call, or with one glMultiDrawArrays if they are too many for a buffer texture.
+// The control points of all curves are drawn by one instanced draw call.
+class CurveScene {
+	struct Range { int first = 0, count = 0, pointFirst = 0, pointCount = 0; }; // where a curve lives in the buffers
+
+	GLVertexArray		vao;	// vertex array object
+	GLBuffer			vbo;	// vertex buffer object
+	std::vector<std::unique_ptr<Curve>> curves;
+	std::vector<Range>  ranges;			// one per curve
+	std::vector<std::vector<float>> strips;	// one per curve, its simplified vertexData while simplifying
+	int                 simplifyLevel = INT_MIN;	// the strips are simplified to 2^level world units, INT_MIN if not
+	VertexLayout        layout = LAYOUT_POSITION;
+	int                 bytesPerVertex = 8;
+	std::vector<unsigned char> vertexData;	// packed strips in the vertex layout
+	vec2                quantOrigin, quantSize = vec2(1, 1);	// world space box of the quantized positions
+	std::vector<int>    firsts, counts;	// non-empty strips for glMultiDrawArrays
+	ControlPointRenderer points;		// control points of every curve
+	PointClusters       clusters;		// the control points aggregated for zoomed out views
+	int                 numClustered = 0;	// the first positions of points that the clusters hold
+	ControlPointRenderer clusterPoints;	// the cells of the level drawn last
+	int                 clusterLevel = -1;	// -1 if the points were drawn one by one
+	bool                clustersDirty = true;	// a point or its state changed since the cells were uploaded
+	ControlPointRenderer markerPoint;	// the marker moving along a curve
+	bool                markerVisible = false;
+	vec2                markerPosition;	// world space
+	WideLineRenderer    lines;			// the strips
+	bool                layoutDirty = true;	// a curve was added or its vertex count changed
+	bool                lastResized = false;	// only the vertex or point count of the last curve changed
+	UniformHandle       mvpUniform, positionDecodeUniform, perVertexColorUniform, curveColorUniform;
+
+	void PackPoints(Curve* curve, const Range& range, int from, int to) {
+		const float* xs = curve->controlPoints.xs();
+		const float* ys = curve->controlPoints.ys();
+		for (int i = from; i <= to; i++) {
+			vec2 p(xs[i] + curve->wTranslate.x, ys[i] + curve->wTranslate.y);
+			int k = range.pointFirst + i;
+			if (k < numClustered) clusters.Move(points.positions[k], p);
+			else clusters.Insert(p);
+			points.positions[k] = p;
+		}
+		clustersDirty = true;
+	}
+
+	void Simplify(size_t i) {
+		const std::vector<float>& v = curves[i]->vertexData;
+		SimplifyPolyline(v.data(), (int)v.size() / 2, ldexpf(1, simplifyLevel), strips[i]);
+	}
+
+	// convert the strip of curve i, or count vertices of it from the from-th, to the vertex layout,
+	// fails if a quantized vertex left the box
+	bool PackStrip(size_t i, const Range& range, int from = 0, int count = -1) {
+		if (count < 0) count = range.count;
+		const float* src = Strip(i).data() + from * 2;
+		unsigned char* dst = vertexData.data() + (range.first + from) * bytesPerVertex;
+		switch (layout) {
+		case LAYOUT_INTERLEAVED:
+			for (int i = 0; i < count; i++, src += 2, dst += bytesPerVertex) {
+				float vertex[5] = { src[0], src[1], 1, 1, 0 }; // yellow
+				memcpy(dst, vertex, sizeof(vertex));
+			}
+			break;
+		case LAYOUT_POSITION:
+			if (count > 0) memcpy(dst, src, count * bytesPerVertex);
+			break;
+		case LAYOUT_QUANTIZED:
+			for (int i = 0; i < count; i++, src += 2, dst += bytesPerVertex) {
+				float u = (src[0] - quantOrigin.x) / quantSize.x, v = (src[1] - quantOrigin.y) / quantSize.y;
+				if (!(u >= 0 && u <= 1 && v >= 0 && v <= 1)) return false;
+				unsigned short q[2] = { (unsigned short)(u * 65535 + 0.5f), (unsigned short)(v * 65535 + 0.5f) };
+				memcpy(dst, q, sizeof(q));
+			}
+			break;
+		}
+		return true;
+	}
+
+	void ChangedVertices(const Curve* curve, const Range& range, int& from, int& count) {
+		if (simplify) { from = 0; count = range.count; return; }	// a simplified strip is new all over
+		from = std::max(0, curve->changedVertexFirst);
+		count = std::max(0, std::min(range.count - 1, curve->changedVertexLast) - from + 1);
+	}
+
+	// quantize relative to the bounding box of every strip, with a margin so that dragging rarely leaves it
+	void FitQuantizationBox() {
+		vec2 lo(1e30f, 1e30f), hi(-1e30f, -1e30f);
+		for (size_t k = 0; k < curves.size(); k++) {
+			const std::vector<float>& v = Strip(k);
+			for (size_t i = 0; i + 1 < v.size(); i += 2) {
+				lo = vec2(fminf(lo.x, v[i]), fminf(lo.y, v[i + 1]));
+				hi = vec2(fmaxf(hi.x, v[i]), fmaxf(hi.y, v[i + 1]));
+			}
+		}
+		if (lo.x > hi.x) return; // no vertices
+		vec2 margin = (hi - lo) * 0.25f + vec2(1, 1);
+		quantOrigin = lo - margin;
+		quantSize = hi - lo + margin * 2;
+	}
+
+	// the last curve lies at the end of the buffers, so it grows or shrinks in place while their storage has room,
+	// as a curve being drawn or streamed into does at every point. Its strip is packed and uploaded like the strip
+	// of any changed curve, all of its points are packed here. False if everything must be laid out again.
+	bool ResizeLast() {
+		size_t i = curves.size() - 1;
+		Curve* curve = curves[i].get();
+		Range& range = ranges[i];
+		int count = (int)Strip(i).size() / 2, pointCount = (int)curve->controlPoints.size();
+		if ((size_t)(range.first + count) * bytesPerVertex > vbo.getCapacity() || !lines.ResizeLastStrip(range.first, range.count, count))
+			return false;
+		vertexData.resize((size_t)(range.first + count) * bytesPerVertex);
+		if (range.count > 0) { firsts.pop_back(); counts.pop_back(); }
+		if (count > 0) { firsts.push_back(range.first); counts.push_back(count); }
+		range.count = count;
+		int numPoints = range.pointFirst + pointCount;
+		for (int k = numPoints; k < numClustered; k++) clusters.Remove(points.positions[k]);
+		numClustered = std::min(numClustered, numPoints);
+		points.positions.resize(numPoints);
+		points.states.resize(numPoints);
+		range.pointCount = pointCount;
+		PackPoints(curve, range, 0, pointCount - 1);
+		for (int j = 0; j < pointCount; j++) points.states[range.pointFirst + j] = (unsigned char)StateOf(curve, j);
+		numClustered = numPoints;
+		return true;
+	}
+
+	// recompute where every curve goes and upload all buffers
+	void Relayout() {
+		if (layout == LAYOUT_QUANTIZED) FitQuantizationBox();
+		int numStripVertices = 0, numPoints = 0;
+		for (size_t i = 0; i < curves.size(); i++) {
+			numStripVertices += (int)Strip(i).size() / 2;
+			numPoints += (int)curves[i]->controlPoints.size();
+		}
+		vertexData.resize(numStripVertices * bytesPerVertex);
+		for (int k = numPoints; k < numClustered; k++) clusters.Remove(points.positions[k]);
+		numClustered = std::min(numClustered, numPoints);
+		points.positions.resize(numPoints);
+		points.states.resize(numPoints);
+		firsts.clear(); counts.clear();
+		{
+			ProfileScope scope("pack");	// ends before the upload, which is a phase of its own
+			int first = 0, pointFirst = 0;
+			for (size_t i = 0; i < curves.size(); i++) {
+				Curve* curve = curves[i].get();
+				Range& range = ranges[i];
+				range.first = first;
+				range.count = (int)Strip(i).size() / 2;
+				range.pointFirst = pointFirst;
+				range.pointCount = (int)curve->controlPoints.size();
+				if (range.count > 0) { firsts.push_back(range.first); counts.push_back(range.count); }
+				PackStrip(i, range);
+				PackPoints(curve, range, 0, range.pointCount - 1);
+				for (int j = 0; j < range.pointCount; j++) points.states[range.pointFirst + j] = (unsigned char)StateOf(curve, j);
+				first += range.count;
+				pointFirst += range.pointCount;
+			}
+		}
+		numClustered = numPoints;
+		ProfileScope uploadScope("upload", true);
+		if (!vertexData.empty()) vbo.upload(&vertexData[0], vertexData.size());
+		lines.SetStrips(vbo, layout, numStripVertices, firsts, counts);
+		points.Upload();
+		layoutDirty = false;
+	}
+
+public:
+	void create(VertexLayout _layout = LAYOUT_POSITION) {
+		layout = _layout;
+		mvpUniform = gpuProgram.getUniform("MVP");
+		positionDecodeUniform = gpuProgram.getUniform("positionDecode");
+		perVertexColorUniform = gpuProgram.getUniform("perVertexColor");
+		curveColorUniform = gpuProgram.getUniform("curveColor");
+
+		vao.create();
+		vao.bind();
+
+		vbo.create(); // Generate 1 vertex buffer object
+		vbo.bind();
+		// Enable the vertex attribute arrays
+		glEnableVertexAttribArray(0);  // attribute array 0
+		switch (layout) {
+		case LAYOUT_INTERLEAVED:
+			bytesPerVertex = 5 * sizeof(float);
+			glEnableVertexAttribArray(1);  // attribute array 1
+			// Map attribute array 0 to the vertex data of the interleaved vbo
+			glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, bytesPerVertex, reinterpret_cast<void*>(0)); // attribute array, components/attribute, component type, normalize?, stride, offset
+			// Map attribute array 1 to the color data of the interleaved vbo
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, bytesPerVertex, reinterpret_cast<void*>(2 * sizeof(float)));
+			break;
+		case LAYOUT_POSITION:
+			bytesPerVertex = 2 * sizeof(float);
+			glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, bytesPerVertex, reinterpret_cast<void*>(0));
+			break;
+		case LAYOUT_QUANTIZED:
+			bytesPerVertex = 2 * sizeof(unsigned short);
+			glVertexAttribPointer(0, 2, GL_UNSIGNED_SHORT, GL_TRUE, bytesPerVertex, reinterpret_cast<void*>(0)); // normalized to [0,1]
+			break;
+		}
+
+		points.create();
+		clusterPoints.create();
+		markerPoint.create();
+		lines.create();
+	}
+
+	Curve* Add(Curve* curve) { // the scene takes ownership
+		curves.push_back(std::unique_ptr<Curve>(curve));
+		ranges.push_back(Range());
+		strips.push_back(std::vector<float>());
+		layoutDirty = true;
+		return curve;
+	}
+
+	void Remove(Curve* curve) {
+		for (size_t i = 0; i < curves.size(); i++) {
+			if (curves[i].get() != curve) continue;
+			curves.erase(curves.begin() + i);
+			ranges.erase(ranges.begin() + i);
+			strips.erase(strips.begin() + i);
+			layoutDirty = true;
+			return;
+		}
+	}
+
+	Curve* Active() { return curves.empty() ? nullptr : curves.back().get(); } // the curve being edited
+
+	// the strips are simplified to a fraction of a pixel before they are packed, again when the zoom halves or doubles
+	// the pixel, as long as curves are dragged every change of their vertex count costs a relayout
+	bool simplify = false;
+	static constexpr float simplifyPixels = 0.25f;
+
+	// the vertices curve i is drawn with
+	const std::vector<float>& Strip(size_t i) const { return simplify ? strips[i] : curves[i]->vertexData; }
+
+	void VertexCounts(long long& tessellated, long long& drawn) const {
+		tessellated = drawn = 0;
+		for (size_t i = 0; i < curves.size(); i++) {
+			tessellated += curves[i]->vertexData.size() / 2;
+			drawn += Strip(i).size() / 2;
+		}
+	}
+
+	const std::vector<std::unique_ptr<Curve>>& Curves() const { return curves; }
+
+	bool Dirty() const { // some curve changed since it was last tessellated
+		for (const auto& curve : curves) if (curve->dirty) return true;
+		return false;
+	}
+
+	WideLineRenderer& Lines() { return lines; }
+
+	void SetMarker(bool visible, vec2 wPosition = vec2(0, 0)) { markerVisible = visible; markerPosition = wPosition; }
+
+	bool Marker(vec2& wPosition) const { // false if it is hidden
+		wPosition = markerPosition;
+		return markerVisible;
+	}
+
+	// refresh the highlight of control point i of the active curve, only its state byte is uploaded
+	void RefreshPointState(int i) {
+		Curve* curve = Active();
+		if (curve == nullptr || i < 0 || layoutDirty || i >= ranges.back().pointCount) return;
+		points.SetState(ranges.back().pointFirst + i, StateOf(curve, i));
+		if (clusterLevel >= 0) clustersDirty = true;
+	}
+
+	PointState StateOf(const Curve* curve, int i) const {
+		if (i == curve->selectedPointIndex) return POINT_SELECTED;
+		if (i == curve->hoveredPointIndex) return POINT_HOVERED;
+		return POINT_NORMAL;
+	}
+
+	// tessellate the curves that changed and return their indices, nothing is uploaded to the GPU
+	FrameVector<size_t> Tessellate() {
+		ProfileScope scope("tessellate");
+		FrameVector<size_t> changed;
+		int level = simplify ? (int)floorf(log2f(simplifyPixels * camera.Size().x / windowWidth)) : INT_MIN;
+		bool resimplify = level != simplifyLevel;	// switched on or off, or zoomed far enough
+		if (resimplify) { simplifyLevel = level; layoutDirty = true; }
+		lastResized = false;
+		for (size_t i = 0; i < curves.size(); i++) {
+			Curve* curve = curves[i].get();
+			if (!curve->dirty) {
+				if (resimplify && simplify) Simplify(i);
+				continue;
+			}
+			curve->arcLengthStale = true;	// unless Tessellate builds it
+			curve->Tessellate();
+			curve->dirty = false;
+			if (simplify) Simplify(i);
+			if ((int)Strip(i).size() / 2 != ranges[i].count || (int)curve->controlPoints.size() != ranges[i].pointCount) {
+				if (i + 1 == curves.size()) lastResized = true;
+				else layoutDirty = true;
+			}
+			changed.push_back(i);
+		}
+		return changed;
+	}
+
+	// the changes of the curves are drawn, the next frame starts from a clean slate
+	void ForgetChanges(const FrameVector<size_t>& changed) {
+		for (size_t i : changed) {
+			Curve* curve = curves[i].get();
+			curve->dirtyPointFirst = INT_MAX; curve->dirtyPointLast = -1;
+			curve->changedVertexFirst = 0; curve->changedVertexLast = INT_MAX;
+		}
+	}
+
+	static const int minClusteredPoints = 4096;	// fewer points are always drawn one by one
+
+	// the points are aggregated in cells about as wide as a drawn point, refined level by level as the camera zooms in,
+	// until the cells are smaller than the points or hardly fewer than them. The highlighted points of the active curve
+	// are drawn on top of the cells.
+	void DrawPoints(const mat4& MVPTransform) {
+		int numPoints = (int)points.positions.size();
+		int level = numPoints >= minClusteredPoints ? PointClusters::LevelFor(10.0f * camera.Size().x / windowWidth) : -1;
+		if (level >= 0 && clusters.Build(level, points.positions) * 2 > (size_t)numPoints) level = -1;
+		if (level < 0) {
+			clusterLevel = -1;
+			points.Draw(MVPTransform);
+			profiler().count("points drawn", numPoints);
+			return;
+		}
+		if (level != clusterLevel || clustersDirty) {
+			clusters.Instances(level, clusterPoints.positions, clusterPoints.states);
+			Curve* active = Active();
+			for (int i : { active->hoveredPointIndex, active->selectedPointIndex }) {
+				if (i < 0 || i >= ranges.back().pointCount) continue;
+				clusterPoints.positions.push_back(points.positions[ranges.back().pointFirst + i]);
+				clusterPoints.states.push_back((unsigned char)StateOf(active, i));
+			}
+			clusterPoints.Upload();
+			clusterLevel = level;
+			clustersDirty = false;
+		}
+		clusterPoints.Draw(MVPTransform);
+		profiler().count("points drawn", clusterPoints.positions.size());
+	}
+
+	void Draw() {
+		// only the curves that changed are tessellated again
+		FrameVector<size_t> changed = Tessellate();
+		bool resized = lastResized && !layoutDirty && ResizeLast();
+		if (lastResized && !resized) layoutDirty = true;
+		// copy data to the GPU, either everything or just the ranges of the changed curves
+		if (!layoutDirty) {
+			ProfileScope scope("pack");
+			for (size_t i : changed) {
+				Curve* curve = curves[i].get();
+				int from, count;
+				ChangedVertices(curve, ranges[i], from, count);
+				if (!PackStrip(i, ranges[i], from, count)) { layoutDirty = true; break; } // outside of the quantization box
+				if (curve->dirtyPointLast >= 0) PackPoints(curve, ranges[i], curve->dirtyPointFirst, curve->dirtyPointLast);
+			}
+		}
+		if (layoutDirty) Relayout();
+		else if (!changed.empty()) {
+			ProfileScope scope("upload", true);
+			vbo.bind();
+			for (size_t i : changed) {
+				const Range& range = ranges[i];
+				int from, count;
+				ChangedVertices(curves[i].get(), range, from, count);
+				if (count > 0) {
+					glBufferSubData(GL_ARRAY_BUFFER, (range.first + from) * bytesPerVertex, count * bytesPerVertex, &vertexData[(range.first + from) * bytesPerVertex]);
+					profiler().count("bytes uploaded", count * bytesPerVertex);
+				}
+			}
+			if (resized) {
+				lines.UploadFlags(ranges.back().first);
+				points.UploadFrom(ranges.back().pointFirst);
+			}
+			for (size_t i : changed) {
+				Curve* curve = curves[i].get();
+				if (resized && i + 1 == curves.size()) continue; // its points are uploaded already
+				if (curve->dirtyPointLast < 0) continue;
+				points.UploadPositions(ranges[i].pointFirst + curve->dirtyPointFirst, curve->dirtyPointLast - curve->dirtyPointFirst + 1);
+			}
+		}
+		ForgetChanges(changed);
+		if (profiler().enabled) {
+			long long tessellated, drawn;
+			VertexCounts(tessellated, drawn);
+			profiler().count("vertices tessellated", tessellated);
+			profiler().count("vertices drawn", drawn);
+		}
+
+		// set GPU uniform matrix variable MVP with the content of CPU variable MVPTransform, the curves are already in world space
+		mat4 MVPTransform = camera.V() * camera.P();
+
+		ProfileScope scope("draw", true);
+		// draw all curves
+		vec4 positionDecode = (layout == LAYOUT_QUANTIZED) ? vec4(quantOrigin.x, quantOrigin.y, quantSize.x, quantSize.y) : vec4(0, 0, 1, 1);
+		vec3 color(1, 1, 0); // yellow
+		if (!firsts.empty() && !lines.Draw(MVPTransform, positionDecode, layout == LAYOUT_INTERLEAVED, color)) {
+			gpuProgram.Use();
+			gpuProgram.setUniform(MVPTransform, mvpUniform);
+			gpuProgram.setUniform(positionDecode, positionDecodeUniform);
+			gpuProgram.setUniform(layout == LAYOUT_INTERLEAVED ? 1 : 0, perVertexColorUniform);
+			gpuProgram.setUniform(color, curveColorUniform);
+			vao.bind();
+			glState().lineWidth(lines.width);
+			glMultiDrawArrays(GL_LINE_STRIP, &firsts[0], &counts[0], (int)firsts.size());
+		}
+
+		// draw all control points, or the cells of the points when many of them would cover each other
+		DrawPoints(MVPTransform);
+
+		if (markerVisible) {
+			markerPoint.positions.assign(1, markerPosition);
+			markerPoint.states.assign(1, (unsigned char)POINT_MARKER);
+			markerPoint.Upload();
+			markerPoint.Draw(MVPTransform);
+		}
+	}
+};
+
+CurveScene scene;	// every curve drawn so far, the last one is being edited
+
+// Bar chart of the last profiled frame in the bottom left corner: one row per phase,
+// the CPU time in the color of the phase and the GPU time below it in a darker shade, 1 msec is 1/8 of the window
+class ProfilerOverlay {
+	GLVertexArray vao;
+	GLBuffer vbo;
+	UniformHandle mvpUniform, positionDecodeUniform, perVertexColorUniform, curveColorUniform;
+
+public:
+	bool visible = false;
+
+	void create() {
+		mvpUniform = gpuProgram.getUniform("MVP");
+		positionDecodeUniform = gpuProgram.getUniform("positionDecode");
+		perVertexColorUniform = gpuProgram.getUniform("perVertexColor");
+		curveColorUniform = gpuProgram.getUniform("curveColor");
+		vao.create();
+		vao.bind();
+		vbo.create();
+		vbo.bind();
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+	}
+
+	void Draw() {
+		const Profiler::Frame& frame = profiler().last;
+		if (!visible || frame.numPhases == 0) return;
+		vec2 corners[Profiler::maxPhases * 8];	// 4 per bar, in normalized device coordinates
+		int numCorners = 0;
+		const float left = -0.95f, bottom = -0.95f, rowHeight = 0.04f, msecWidth = 0.25f;
+		for (int i = 0; i < frame.numPhases; i++) {
+			float times[2] = { frame.cpu[i], frame.gpu[i] };
+			for (int gpu = 0; gpu < 2; gpu++) {
+				float y = bottom + (i * 2 + (1 - gpu)) * rowHeight, width = fminf(fmaxf(times[gpu], 0) * msecWidth, 1.9f);
+				corners[numCorners++] = vec2(left, y); corners[numCorners++] = vec2(left + width, y);
+				corners[numCorners++] = vec2(left, y + rowHeight * 0.8f); corners[numCorners++] = vec2(left + width, y + rowHeight * 0.8f);
+			}
+		}
+		vbo.upload(corners, numCorners * sizeof(vec2));
+
+		gpuProgram.Use();
+		gpuProgram.setUniform(mat4(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1), mvpUniform);
+		gpuProgram.setUniform(vec4(0, 0, 1, 1), positionDecodeUniform);
+		gpuProgram.setUniform(0, perVertexColorUniform);
+		vao.bind();
+		const vec3 colors[] = { vec3(0.2f, 0.6f, 1), vec3(0.2f, 1, 0.4f), vec3(1, 0.5f, 0.2f), vec3(1, 0.3f, 0.8f), vec3(0.8f, 0.8f, 0.8f), vec3(0.6f, 0.4f, 1) };
+		for (int i = 0; i < frame.numPhases; i++) {
+			vec3 color = colors[i % (sizeof(colors) / sizeof(colors[0]))];
+			for (int gpu = 0; gpu < 2; gpu++) {
+				gpuProgram.setUniform(gpu ? color * 0.5f : color, curveColorUniform);
+				glDrawArrays(GL_TRIANGLE_STRIP, (i * 2 + gpu) * 4, 4);
+			}
+		}
+	}
+};
+
+ProfilerOverlay profilerOverlay;
+
+// Draws anti-aliased polylines and control point squares into an RGBA8 image on the CPU, for machines without a GPU.
+// The image is cut into tiles and the segments are binned to the tiles their boxes touch, then the threads take
+// the tiles one by one, so no two threads write the same pixel. The bins and the threads are kept between the frames. A segment covers a pixel by the distance of the
+// pixel center from it: the lines are capsules with round joins and caps like those of the GL path, and their
+// edges fade out over one pixel. The distances of 4 pixels of a row are computed at once with SSE2.
+class SoftwareRasterizer {
+	static constexpr int tileSize = 64;	// pixels, a multiple of 4
+	struct Segment { float x0, y0, x1, y1; };	// in pixels
+	struct Square { float x, y; vec3 color; };	// center in pixels
+
+	int width = 0, height = 0, tilesX = 0, tilesY = 0;
+	float a[6] = { 1, 0, 0, 0, 1, 0 };	// world to pixels: x' = a0 x + a1 y + a2, y' = a3 x + a4 y + a5
+	std::vector<Segment> segments;
+	std::vector<Square> squares;
+	struct Bins {	// the items of tile t are items[first[t]] .. items[first[t + 1] - 1]
+		std::vector<int> first;	// one more than the tiles
+		std::vector<int> items;
+	};
+	std::vector<Bins> segmentBins;	// per binning chunk, the chunks keep the order, only the first numChunks are used
+	int numChunks = 0;
+	Bins squareBins;
+	std::vector<std::vector<float>> coverages;	// per drawing thread
+
+	void ToPixels(float x, float y, float& px, float& py) const {
+		px = a[0] * x + a[1] * y + a[2];
+		py = a[3] * x + a[4] * y + a[5];
+	}
+
+	// the tiles touched by the box, false if it is outside of the image
+	bool TileRange(float xMin, float yMin, float xMax, float yMax, int& tx0, int& ty0, int& tx1, int& ty1) const {
+		if (!(xMax >= 0 && yMax >= 0 && xMin < width && yMin < height)) return false; // also rejects NaN
+		tx0 = std::max(0, (int)xMin / tileSize); tx1 = std::min(tilesX - 1, (int)xMax / tileSize);
+		ty0 = std::max(0, (int)yMin / tileSize); ty1 = std::min(tilesY - 1, (int)yMax / tileSize);
+		return true;
+	}
+
+	// raise the coverage of the pixels of the tile near the segment to its coverage
+	void Cover(const Segment& s, int tileX, int tileY, float* coverage) const {
+		float r = lineWidth / 2 + 0.5f;	// where the coverage drops to 0
+		int x0 = std::max(tileX, (int)floorf(fminf(s.x0, s.x1) - r)), x1 = std::min(tileX + tileSize - 1, (int)floorf(fmaxf(s.x0, s.x1) + r));
+		int y0 = std::max(tileY, (int)floorf(fminf(s.y0, s.y1) - r)), y1 = std::min(tileY + tileSize - 1, (int)floorf(fmaxf(s.y0, s.y1) + r));
+		if (x0 > x1 || y0 > y1) return;
+		x0 = tileX + (x0 - tileX) / 4 * 4;	// whole quads of the tile row
+		float dx = s.x1 - s.x0, dy = s.y1 - s.y0, length2 = dx * dx + dy * dy;
+		float invLength2 = length2 > 0 ? 1 / length2 : 0;	// a point is a disc
+#if defined(__SSE2__) || defined(_M_X64)
+		const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1), vr = _mm_set1_ps(r);
+		const __m128 vdx = _mm_set1_ps(dx), vdy = _mm_set1_ps(dy), vinv = _mm_set1_ps(invLength2);
+		const __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);	// pixel centers
+		for (int y = y0; y <= y1; y++) {
+			__m128 py = _mm_set1_ps(y + 0.5f - s.y0), pydy = _mm_mul_ps(py, vdy);
+			float* row = coverage + (y - tileY) * tileSize - tileX;
+			for (int x = x0; x <= x1; x += 4) {
+				__m128 px = _mm_add_ps(_mm_set1_ps(x - s.x0), offsets);
+				__m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(px, vdx), pydy), vinv);
+				t = _mm_min_ps(_mm_max_ps(t, zero), one);
+				__m128 ex = _mm_sub_ps(px, _mm_mul_ps(t, vdx)), ey = _mm_sub_ps(py, _mm_mul_ps(t, vdy));
+				__m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)));
+				__m128 c = _mm_min_ps(_mm_max_ps(_mm_sub_ps(vr, distance), zero), one);
+				_mm_storeu_ps(row + x, _mm_max_ps(_mm_loadu_ps(row + x), c));
+			}
+		}
+#else
+		for (int y = y0; y <= y1; y++) {
+			float py = y + 0.5f - s.y0;
+			float* row = coverage + (y - tileY) * tileSize - tileX;
+			for (int x = x0; x <= x1; x++) {
+				float px = x + 0.5f - s.x0;
+				float t = fminf(fmaxf((px * dx + py * dy) * invLength2, 0), 1);
+				float ex = px - t * dx, ey = py - t * dy;
+				float c = fminf(fmaxf(r - sqrtf(ex * ex + ey * ey), 0), 1);
+				row[x] = fmaxf(row[x], c);
+			}
+		}
+#endif
+	}
+
+	// the pixels of the square are blended over the tile by the part of their area it covers
+	void Blend(const Square& square, int tileX, int tileY, unsigned char* rgba) const {
+		float h = pointSize / 2;
+		int x0 = std::max(tileX, (int)floorf(square.x - h)), x1 = std::min(tileX + tileSize, width) - 1;
+		int y0 = std::max(tileY, (int)floorf(square.y - h)), y1 = std::min(tileY + tileSize, height) - 1;
+		x1 = std::min(x1, (int)floorf(square.x + h)); y1 = std::min(y1, (int)floorf(square.y + h));
+		for (int y = y0; y <= y1; y++) {
+			float cy = fminf(fminf(y + 1.0f, square.y + h) - fmaxf((float)y, square.y - h), 1);
+			unsigned char* pixel = rgba + ((size_t)y * width + x0) * 4;
+			for (int x = x0; x <= x1; x++, pixel += 4) {
+				float alpha = cy * fminf(fminf(x + 1.0f, square.x + h) - fmaxf((float)x, square.x - h), 1);
+				if (alpha <= 0) continue;
+				const float color[3] = { square.color.x, square.color.y, square.color.z };
+				for (int k = 0; k < 3; k++) pixel[k] = (unsigned char)(pixel[k] * (1 - alpha) + color[k] * 255 * alpha + 0.5f);
+				pixel[3] = (unsigned char)(pixel[3] * (1 - alpha) + 255 * alpha + 0.5f);
+			}
+		}
+	}
+
+	// bin items [begin, end) to the tiles that tiles(i, tx0, ty0, tx1, ty1) returns for them, counted first so that
+	// each tile gets one run of the array; the arrays only grow, by half again, so a steady frame does not allocate
+	template<typename TileRangeOf>
+	void Bin(Bins& bins, int begin, int end, const TileRangeOf& tiles) const {
+		int numTiles = tilesX * tilesY, tx0, ty0, tx1, ty1;
+		bins.first.assign(numTiles + 1, 0);
+		for (int i = begin; i < end; i++) {
+			if (!tiles(i, tx0, ty0, tx1, ty1)) continue;
+			for (int ty = ty0; ty <= ty1; ty++)
+				for (int tx = tx0; tx <= tx1; tx++) bins.first[ty * tilesX + tx + 1]++;
+		}
+		for (int t = 0; t < numTiles; t++) bins.first[t + 1] += bins.first[t];
+		size_t count = bins.first[numTiles];
+		if (bins.items.capacity() < count) bins.items.reserve(count + count / 2);
+		bins.items.resize(count);
+		for (int i = begin; i < end; i++) {	// first[t] runs to the end of the run of tile t
+			if (!tiles(i, tx0, ty0, tx1, ty1)) continue;
+			for (int ty = ty0; ty <= ty1; ty++)
+				for (int tx = tx0; tx <= tx1; tx++) bins.items[bins.first[ty * tilesX + tx]++] = i;
+		}
+		for (int t = numTiles; t > 0; t--) bins.first[t] = bins.first[t - 1];
+		bins.first[0] = 0;
+	}
+
+	void DrawTile(int tile, unsigned char* rgba, std::vector<float>& coverage) const {
+		int tileX = (tile % tilesX) * tileSize, tileY = (tile / tilesX) * tileSize;
+		std::fill(coverage.begin(), coverage.end(), 0.0f);
+		for (int c = 0; c < numChunks; c++) {
+			const Bins& bins = segmentBins[c];
+			for (int k = bins.first[tile]; k < bins.first[tile + 1]; k++) Cover(segments[bins.items[k]], tileX, tileY, &coverage[0]);
+		}
+		// the lines over the transparent black background
+		int w = std::min(tileSize, width - tileX), h = std::min(tileSize, height - tileY);
+		for (int y = 0; y < h; y++) {
+			const float* c = &coverage[y * tileSize];
+			unsigned char* pixel = rgba + ((size_t)(tileY + y) * width + tileX) * 4;
+			for (int x = 0; x < w; x++, pixel += 4) {
+				unsigned char value = (unsigned char)(c[x] * 255 + 0.5f);
+				pixel[0] = (unsigned char)(lineColor.x * value + 0.5f);
+				pixel[1] = (unsigned char)(lineColor.y * value + 0.5f);
+				pixel[2] = (unsigned char)(lineColor.z * value + 0.5f);
+				pixel[3] = value;
+			}
+		}
+		for (int k = squareBins.first[tile]; k < squareBins.first[tile + 1]; k++) Blend(squares[squareBins.items[k]], tileX, tileY, rgba);
+	}
+
+public:
+	float lineWidth = 2;			// pixels
+	float pointSize = 10;			// pixels
+	vec3 lineColor = vec3(1, 1, 0);	// yellow
+
+	// start a frame of the size, MVP maps the world to normalized device coordinates
+	void Begin(int _width, int _height, const mat4& MVP) {
+		width = _width; height = _height;
+		tilesX = (width + tileSize - 1) / tileSize;
+		tilesY = (height + tileSize - 1) / tileSize;
+		// the camera is a 2D affine map, so only the x, y and translation rows of the matrix matter
+		a[0] = MVP[0][0] * width / 2; a[1] = MVP[1][0] * width / 2; a[2] = (MVP[3][0] + 1) * width / 2;
+		a[3] = MVP[0][1] * height / 2; a[4] = MVP[1][1] * height / 2; a[5] = (MVP[3][1] + 1) * height / 2;
+		segments.clear();
+		squares.clear();
+	}
+
+	// the strip of count x, y pairs in world space, the segments outside of the image are dropped and
+	// the vertices closer than a quarter pixel to the previous one are skipped, dense strips look the same with fewer segments
+	void AddStrip(const float* xy, int count) {
+		float r = lineWidth / 2 + 1;
+		float px0 = 0, py0 = 0;
+		for (int i = 0; i < count; i++, xy += 2) {
+			float px1, py1;
+			ToPixels(xy[0], xy[1], px1, py1);
+			if (i == 0) { px0 = px1; py0 = py1; continue; }
+			if (i < count - 1 && (px1 - px0) * (px1 - px0) + (py1 - py0) * (py1 - py0) < 0.0625f) continue;
+			if (fmaxf(px0, px1) > -r && fmaxf(py0, py1) > -r && fminf(px0, px1) < width + r && fminf(py0, py1) < height + r)
+				segments.push_back({ px0, py0, px1, py1 });
+			px0 = px1; py0 = py1;
+		}
+	}
+
+	// a control point in world space, drawn over the lines in the order of the calls
+	void AddPoint(vec2 wPoint, vec3 color) {
+		Square square;
+		ToPixels(wPoint.x, wPoint.y, square.x, square.y);
+		square.color = color;
+		squares.push_back(square);
+	}
+
+	// draw everything added since Begin into the bottom-up RGBA rows of the image
+	void End(unsigned char* rgba) {
+		int numTiles = tilesX * tilesY;
+		int numThreads = std::max(1, std::min((int)std::thread::hardware_concurrency(), numTiles));
+
+		// bin the segments in chunks, every chunk into its own bins
+		const int chunkSize = 1 << 16;
+		numChunks = (int)((segments.size() + chunkSize - 1) / chunkSize);
+		if ((int)segmentBins.size() < numChunks) segmentBins.resize(numChunks);
+		std::atomic<int> nextChunk{ 0 };
+		float r = lineWidth / 2 + 0.5f;
+		auto segmentTiles = [&](int i, int& tx0, int& ty0, int& tx1, int& ty1) {
+			const Segment& s = segments[i];
+			return TileRange(fminf(s.x0, s.x1) - r, fminf(s.y0, s.y1) - r, fmaxf(s.x0, s.x1) + r, fmaxf(s.y0, s.y1) + r, tx0, ty0, tx1, ty1);
+		};
+		workerThreads().run(numThreads, [&]() {
+			for (int c; (c = nextChunk++) < numChunks; )
+				Bin(segmentBins[c], c * chunkSize, std::min((int)segments.size(), (c + 1) * chunkSize), segmentTiles);
+		});
+		float h = pointSize / 2;
+		Bin(squareBins, 0, (int)squares.size(), [&](int i, int& tx0, int& ty0, int& tx1, int& ty1) {
+			return TileRange(squares[i].x - h, squares[i].y - h, squares[i].x + h, squares[i].y + h, tx0, ty0, tx1, ty1);
+		});
+
+		std::atomic<int> nextTile{ 0 }, nextCoverage{ 0 };
+		if ((int)coverages.size() < numThreads) coverages.resize(numThreads);
+		for (auto& coverage : coverages) coverage.resize(tileSize * tileSize);
+		workerThreads().run(numThreads, [&]() {
+			std::vector<float>& coverage = coverages[nextCoverage++];
+			for (int tile; (tile = nextTile++) < numTiles; ) DrawTile(tile, rgba, coverage);
+		});
+	}
+};
+
+// Where onDisplay draws the frames: with OpenGL, or on the CPU when there is no OpenGL context
+class RenderBackend {
+public:
+	virtual void create() = 0;
+	virtual void Draw() = 0;	// the whole frame
+	virtual ~RenderBackend() { }
+};
+
+class GLBackend : public RenderBackend {
+public:
+	void create() {
+		glViewport(0, 0, 600, 600); 	// Position and size of the photograph on screen
+
+		// create program for the GPU
+		// both programs are queued before waiting for either, so the driver can compile them in parallel
+		gpuProgram.createAsync(vertexSource, fragmentSource, "fragmentColor");
+		pointProgram.createAsync(pointVertexSource, fragmentSource, "fragmentColor");
+		wideLineProgram.createAsync(wideLineVertexSource, wideLineFragmentSource, "fragmentColor");
+		gpuProgram.finish();
+		pointProgram.finish();
+		wideLineProgram.finish();
+
+		// Create objects by setting up their vertex data on the GPU, this also resolves the uniforms of the programs
+		scene.create();
+		profilerOverlay.create();
+	}
+
+	void Draw() {
+		glClearColor(0, 0, 0, 0);							// background color 
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // clear the screen
+
+		scene.Draw();
+		profilerOverlay.Draw();
+	}
+};
+
+// Draws the tessellated strips and the control points of the scene into softwareFramebuffer,
+// in the colors of the shaders, the profiler overlay is not shown
+class SoftwareBackend : public RenderBackend {
+	SoftwareRasterizer rasterizer;
+public:
+	void create() { }
+
+	void Draw() {
+		scene.ForgetChanges(scene.Tessellate());	// the curves are read directly, there is nothing to upload
+
+		ProfileScope scope("draw");
+		rasterizer.lineWidth = scene.Lines().width;
+		rasterizer.Begin(windowWidth, windowHeight, camera.V() * camera.P());
+		for (size_t i = 0; i < scene.Curves().size(); i++) rasterizer.AddStrip(scene.Strip(i).data(), (int)scene.Strip(i).size() / 2);
+		const vec3 colors[] = { vec3(1, 0, 0), vec3(1, 0.5f, 0), vec3(1, 1, 1), vec3(0, 1, 1) };	// normal red, hovered orange, selected white, marker cyan
+		for (auto& curve : scene.Curves()) {
+			const float* xs = curve->controlPoints.xs();
+			const float* ys = curve->controlPoints.ys();
+			for (int i = 0; i < (int)curve->controlPoints.size(); i++)
+				rasterizer.AddPoint(vec2(xs[i] + curve->wTranslate.x, ys[i] + curve->wTranslate.y), colors[scene.StateOf(curve.get(), i)]);
+		}
+		vec2 marker;
+		if (scene.Marker(marker)) rasterizer.AddPoint(marker, colors[POINT_MARKER]);
+		rasterizer.End(softwareFramebuffer());
+	}
+};
+
+std::unique_ptr<RenderBackend> backend;	// chosen in onInitialization
+
+// Binary curve files: a header, one record per curve, then the x, y, ts, knot and weight arrays of every curve, each starting
+// at a 32 byte boundary of the file, all little endian. The mapping of the file starts at a page boundary,
+// so the x and y arrays are viewed in place by the control points of the loaded curves.
+struct CurveFileHeader {
+	char magic[4];				// "CRVS"
+	unsigned int version;
+	unsigned int numCurves;
+	unsigned int recordOffset;	// where the first record starts
+};
+
+struct CurveFileRecord {
+	unsigned int type;				// CurveType
+	float tension;					// of CatmullRom splines
+	float translateX, translateY;	// wTranslate
+	unsigned long long numPoints;
+	unsigned long long xsOffset, ysOffset, tsOffset;	// tsOffset is 0 if the curve has no knots (Bezier)
+	unsigned long long knotsOffset, weightsOffset;		// of NURBS, numPoints + degree + 1 knots and numPoints weights, else 0
+};
+static_assert(sizeof(CurveFileHeader) == 16 && sizeof(CurveFileRecord) == 64, "the file layout must not depend on the compiler");
+
+const unsigned int curveFileVersion = 2;	// 2: knots and weights of NURBS
+
+// write every curve of the session into a curve file, through a temporary file
+// because the loaded curves may still view the mapping of the file being replaced
+bool SaveCurves(const char* pathname, const std::vector<std::unique_ptr<Curve>>& curves) {
+	auto align = [](unsigned long long offset) { return (offset + 31) / 32 * 32; };
+	CurveFileHeader header = { { 'C', 'R', 'V', 'S' }, curveFileVersion, (unsigned int)curves.size(), sizeof(CurveFileHeader) };
+	std::vector<CurveFileRecord> records(curves.size());
+	unsigned long long offset = align(sizeof(header) + records.size() * sizeof(CurveFileRecord));
+	for (size_t i = 0; i < curves.size(); i++) {
+		const Curve* curve = curves[i].get();
+		CurveFileRecord& record = records[i];
+		const CatmullRom* catmullrom = dynamic_cast<const CatmullRom*>(curve);
+		const BSpline* bspline = dynamic_cast<const BSpline*>(curve);
+		record.type = curve->Type();
+		record.tension = catmullrom ? catmullrom->tension : 0;
+		record.translateX = curve->wTranslate.x;
+		record.translateY = curve->wTranslate.y;
+		record.numPoints = curve->controlPoints.size();
+		unsigned long long bytes = record.numPoints * sizeof(float);
+		record.xsOffset = offset;
+		offset = align(offset + bytes);
+		record.ysOffset = offset;
+		offset = align(offset + bytes);
+		bool hasKnots = curve->ts.size() == curve->controlPoints.size() && record.numPoints > 0;
+		record.tsOffset = hasKnots ? offset : 0;
+		if (hasKnots) offset = align(offset + bytes);
+		size_t numKnots = (size_t)record.numPoints + (bspline ? bspline->Degree() : 0) + 1;
+		bool hasNurbs = bspline && record.numPoints >= 2 && bspline->knots.size() == numKnots && bspline->weights.size() == record.numPoints;
+		record.knotsOffset = hasNurbs ? offset : 0;
+		if (hasNurbs) offset = align(offset + numKnots * sizeof(float));
+		record.weightsOffset = hasNurbs ? offset : 0;
+		if (hasNurbs) offset = align(offset + bytes);
+	}
+
+	std::string temporary = std::string(pathname) + ".tmp";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (!file) return false;
+	static const char zeros[32] = { 0 };
+	unsigned long long written = 0;
+	auto write = [&](const void* data, unsigned long long at, size_t bytes) {
+		fwrite(zeros, 1, (size_t)(at - written), file);	// padding up to the aligned offset
+		if (bytes > 0) fwrite(data, 1, bytes, file);
+		written = at + bytes;
+	};
+	write(&header, 0, sizeof(header));
+	if (!records.empty()) write(&records[0], sizeof(header), records.size() * sizeof(CurveFileRecord));
+	for (size_t i = 0; i < curves.size(); i++) {
+		const Curve* curve = curves[i].get();
+		size_t bytes = (size_t)records[i].numPoints * sizeof(float);
+		write(curve->controlPoints.xs(), records[i].xsOffset, bytes);
+		write(curve->controlPoints.ys(), records[i].ysOffset, bytes);
+		if (records[i].tsOffset) write(&curve->ts[0], records[i].tsOffset, bytes);
+		if (const BSpline* bspline = records[i].knotsOffset ? dynamic_cast<const BSpline*>(curve) : nullptr) {
+			write(&bspline->knots[0], records[i].knotsOffset, bspline->knots.size() * sizeof(float));
+			write(&bspline->weights[0], records[i].weightsOffset, bytes);
+		}
+	}
+	bool OK = ferror(file) == 0;
+	OK = fclose(file) == 0 && OK;
+#if defined(_WIN32)
+	remove(pathname);	// fails while the file is mapped, then so does the rename
+#endif
+	if (!OK || rename(temporary.c_str(), pathname) != 0) {
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Loads the curves of a curve file progressively: each LoadMore shows the next, twice as large chunk of the
+// points, so the first segments are drawn while the rest of the file is still being read in by the system.
+class CurveLoader {
+	struct Loading {
+		Curve* curve;
+		std::shared_ptr<MappedFile> file;	// shared with the control points that view it
+		const CurveFileRecord* record;		// in the file
+		size_t loaded;						// points shown so far
+	};
+
+	std::vector<Loading> loading;
+	size_t chunk = 0;					// points to show in the next step
+
+	static const float* Floats(const MappedFile& file, unsigned long long offset) { return (const float*)(file.data() + offset); }
+
+	static unsigned long long NumKnots(const CurveFileRecord& record) {	// numPoints + degree + 1 as in BSpline::Degree
+		return record.numPoints + std::max<unsigned long long>(1, std::min<unsigned long long>(3, record.numPoints - 1)) + 1;
+	}
+
+	static bool Valid(const MappedFile* file, const CurveFileRecord& record) {
+		unsigned long long size = file->size();
+		auto fits = [&](unsigned long long offset, unsigned long long count) {
+			return offset % sizeof(float) == 0 && offset <= size && count * sizeof(float) <= size - offset;
+		};
+		unsigned long long n = record.numPoints;
+		bool nurbs = record.knotsOffset != 0 || record.weightsOffset != 0;
+		return record.type <= CURVE_BSPLINE && n < (1ULL << 31) &&
+			fits(record.xsOffset, n) && fits(record.ysOffset, n) && (record.tsOffset == 0 || fits(record.tsOffset, n)) &&
+			(!nurbs || (record.type == CURVE_BSPLINE && n >= 2 && fits(record.knotsOffset, NumKnots(record)) && fits(record.weightsOffset, n)));
+	}
+
+public:
+	static const size_t firstChunk = 1 << 14;
+
+	// the records of the curves in the file, nullptr if it is not a curve file of this version
+	static const CurveFileRecord* Records(const MappedFile& file, const char* pathname, unsigned int& numCurves) {
+		const CurveFileHeader* header = (const CurveFileHeader*)file.data();
+		if (!file.isOpen() || file.size() < sizeof(CurveFileHeader) || memcmp(header->magic, "CRVS", 4) != 0) {
+			printf("%s is not a curve file\n", pathname);
+			return nullptr;
+		}
+		if (header->version != curveFileVersion) {
+			printf("%s has version %u of the curve file format, only version %u is supported\n", pathname, header->version, curveFileVersion);
+			return nullptr;
+		}
+		if (header->recordOffset % 8 != 0 || header->recordOffset + (unsigned long long)header->numCurves * sizeof(CurveFileRecord) > file.size()) {
+			printf("%s is truncated\n", pathname);
+			return nullptr;
+		}
+		numCurves = header->numCurves;
+		return (const CurveFileRecord*)(file.data() + header->recordOffset);
+	}
+
+	// the curve of record i without points, nullptr if the record is damaged
+	static Curve* NewCurve(const MappedFile& file, const char* pathname, const CurveFileRecord* records, unsigned int i) {
+		const CurveFileRecord& record = records[i];
+		if (!Valid(&file, record)) {
+			printf("Curve %u of %s is damaged, skipped\n", i, pathname);
+			return nullptr;
+		}
+		Curve* curve = nullptr;
+		switch (record.type) {
+		case CURVE_LAGRANGE: curve = new Lagrange(); break;
+		case CURVE_BEZIER: curve = new Bezier(); break;
+		case CURVE_CATMULLROM: curve = new CatmullRom(); ((CatmullRom*)curve)->tension = record.tension; break;
+		case CURVE_PIECEWISE_BEZIER: curve = new PiecewiseBezier(); break;
+		case CURVE_BSPLINE: curve = new BSpline(); break;	// uniform knots and unit weights unless the file has them
+		}
+		curve->wTranslate = vec2(record.translateX, record.translateY);
+		return curve;
+	}
+
+	// let the curve view its first count points in the mapping, the knots are copied from where the last call stopped
+	static void View(Curve* curve, const std::shared_ptr<MappedFile>& file, const CurveFileRecord& record, size_t loaded, size_t count) {
+		curve->controlPoints.view(Floats(*file, record.xsOffset), Floats(*file, record.ysOffset), count, file);
+		if (record.tsOffset) curve->ts.insert(curve->ts.end(), Floats(*file, record.tsOffset) + loaded, Floats(*file, record.tsOffset) + count);
+		if (record.knotsOffset) ((BSpline*)curve)->ViewKnots(Floats(*file, record.knotsOffset), Floats(*file, record.weightsOffset));
+		curve->dirty = true;
+	}
+
+	// add the curves of the file to the scene, their first chunk is shown at once
+	bool Open(const char* pathname, CurveScene& scene) {
+		std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(pathname);
+		unsigned int numCurves = 0;
+		const CurveFileRecord* records = Records(*file, pathname, numCurves);
+		if (records == nullptr) return false;
+		for (unsigned int i = 0; i < numCurves; i++) {
+			if (Curve* curve = NewCurve(*file, pathname, records, i)) loading.push_back({ scene.Add(curve), file, &records[i], 0 });
+		}
+		chunk = firstChunk;
+		LoadMore();
+		return true;
+	}
+
+	// show the next chunk of every curve being loaded, false if there was nothing left
+	bool LoadMore() {
+		if (loading.empty()) return false;
+		for (size_t i = 0; i < loading.size(); ) {
+			Loading& l = loading[i];
+			const MappedFile& file = *l.file;
+			const CurveFileRecord& record = *l.record;
+			size_t count = (size_t)std::min<unsigned long long>(record.numPoints, l.loaded + chunk);
+			View(l.curve, l.file, record, l.loaded, count);
+			// the pages of the next chunk are read in while this one is drawn
+			size_t ahead = std::min<size_t>((size_t)record.numPoints - count, chunk * 2) * sizeof(float);
+			file.prefetch(record.xsOffset + count * sizeof(float), ahead);
+			file.prefetch(record.ysOffset + count * sizeof(float), ahead);
+			if (record.tsOffset) file.prefetch(record.tsOffset + count * sizeof(float), ahead);
+			if (record.knotsOffset) file.prefetch(record.knotsOffset + count * sizeof(float), ahead);
+			if (record.weightsOffset) file.prefetch(record.weightsOffset + count * sizeof(float), ahead);
+			l.loaded = count;
+			if (count == record.numPoints) { loading.erase(loading.begin() + i); continue; }
+			i++;
+		}
+		chunk *= 2;
+		return true;
+	}
+
+	// the curve is about to be edited, show the rest of its points at once so the edit applies to all of them
+	void Finish(Curve* curve) {
+		for (size_t i = 0; i < loading.size(); i++) {
+			Loading& l = loading[i];
+			if (l.curve != curve) continue;
+			View(l.curve, l.file, *l.record, l.loaded, (size_t)l.record->numPoints);
+			loading.erase(loading.begin() + i);
+			return;
+		}
+	}
+
+	bool IsLoading() const { return !loading.empty(); }
+
+	void Forget(Curve* curve) { // the curve is deleted, stop loading it
+		for (size_t i = 0; i < loading.size(); i++)
+			if (loading[i].curve == curve) { loading.erase(loading.begin() + i); return; }
+	}
+};
+
+CurveLoader curveLoader;	// loads the curve file opened last
+
+// Moves a marker along a curve at a constant speed, however the curve is parametrized, and starts over at the end.
+// onIdle advances it by the time elapsed since the previous frame.
+class CurveMarker {
+	Curve* curve = nullptr;
+	float s = 0;		// arc length from the start of the curve
+	long lastTime = 0;	// msec
+public:
+	float speed = 3;	// world units per second, 60 pixels at the initial zoom
+
+	void Start(Curve* _curve, long time) { curve = _curve; s = 0; lastTime = time; }
+	void Stop() { curve = nullptr; }
+	bool IsRunning() const { return curve != nullptr; }
+	void Forget(Curve* deleted) { if (curve == deleted) Stop(); } // the curve is deleted
+
+	// the position of the marker in world space at the time
+	vec2 Advance(long time) {
+		float length = curve->ArcLength().Length();
+		s += speed * (time - lastTime) / 1000.0f;
+		lastTime = time;
+		if (s > length) s = length > 0 ? fmodf(s, length) : 0;
+		vec3 point = curve->PointAtLength(s);
+		return vec2(point.x + curve->wTranslate.x, point.y + curve->wTranslate.y);
+	}
+};
+
+CurveMarker marker;	// moves along the curve that was active when it was started
+
+// Batch mode: --batch directory [--svg | --raw] [--out directory] [--threads n]
+// Tessellates the curves of every .crv file of the directory with the math of the editor and writes them next to
+// the input or into the output directory, as an svg file of polylines or as a raw file of the samples: the number
+// of curves, then for every curve the number of its samples and their x, y pairs, 32-bit little endian numbers.
+// Every file is a task of a work stealing pool, which submits one task per curve, so the curves of a few huge
+// files are shared out among the cores too. The last curve of a file to finish writes the output.
+class BatchExporter {
+	struct Job {
+		std::string input, output;
+		std::shared_ptr<MappedFile> file;
+		std::vector<std::unique_ptr<Curve>> curves;
+		std::atomic<int> remaining{ 0 };	// curves not tessellated yet
+	};
+
+	bool svg = true;
+	std::atomic<long long> filesDone{ 0 }, filesFailed{ 0 }, curvesDone{ 0 }, samplesDone{ 0 };
+
+	bool WriteSvg(const Job& job) {
+		FILE* file = fopen(job.output.c_str(), "w");
+		if (!file) return false;
+		vec2 lo(1e30f, 1e30f), hi(-1e30f, -1e30f);
+		for (auto& curve : job.curves) {
+			const std::vector<float>& v = curve->vertexData;
+			for (size_t i = 0; i + 1 < v.size(); i += 2) {
+				lo = vec2(fminf(lo.x, v[i]), fminf(lo.y, v[i + 1]));
+				hi = vec2(fmaxf(hi.x, v[i]), fmaxf(hi.y, v[i + 1]));
+			}
+		}
+		if (lo.x > hi.x) lo = hi = vec2(0, 0);
+		vec2 margin = (hi - lo) * 0.05f + vec2(0.01f, 0.01f);
+		lo = lo - margin; hi = hi + margin;
+		// the y axis of svg points down, the world y is negated
+		fprintf(file, "<svg xmlns=\"http://www.w3.org/2000/svg\" viewBox=\"%g %g %g %g\">\n", lo.x, -hi.y, hi.x - lo.x, hi.y - lo.y);
+		for (auto& curve : job.curves) {
+			const std::vector<float>& v = curve->vertexData;
+			if (v.size() < 4) continue;
+			fprintf(file, "<polyline fill=\"none\" stroke=\"black\" stroke-width=\"1\" vector-effect=\"non-scaling-stroke\" points=\"");
+			for (size_t i = 0; i + 1 < v.size(); i += 2) fprintf(file, i == 0 ? "%g,%g" : " %g,%g", v[i], -v[i + 1]);
+			fprintf(file, "\"/>\n");
+		}
+		fprintf(file, "</svg>\n");
+		return fclose(file) == 0;
+	}
+
+	bool WriteRaw(const Job& job) {
+		FILE* file = fopen(job.output.c_str(), "wb");
+		if (!file) return false;
+		unsigned int numCurves = (unsigned int)job.curves.size();
+		fwrite(&numCurves, sizeof(numCurves), 1, file);
+		for (auto& curve : job.curves) {
+			unsigned int numSamples = (unsigned int)curve->vertexData.size() / 2;
+			fwrite(&numSamples, sizeof(numSamples), 1, file);
+			if (numSamples > 0) fwrite(&curve->vertexData[0], sizeof(float), numSamples * 2, file);
+		}
+		bool OK = ferror(file) == 0;
+		return fclose(file) == 0 && OK;
+	}
+
+	void Finish(Job& job) {
+		long long samples = 0;
+		for (auto& curve : job.curves) samples += curve->vertexData.size() / 2;
+		if (!(svg ? WriteSvg(job) : WriteRaw(job))) {
+			printf("Cannot write %s\n", job.output.c_str());
+			filesFailed++;
+		}
+		else filesDone++;
+		samplesDone += samples;
+		job.curves.clear();	// the samples of a finished file are not kept
+		job.file.reset();
+	}
+
+	// map the file and submit a task for each of its curves
+	void OpenFile(const std::shared_ptr<Job>& job, WorkStealingPool& pool, int worker) {
+		job->file = std::make_shared<MappedFile>(job->input);
+		unsigned int numCurves = 0;
+		const CurveFileRecord* records = CurveLoader::Records(*job->file, job->input.c_str(), numCurves);
+		if (records == nullptr) { filesFailed++; return; }
+		std::vector<const CurveFileRecord*> loaded;
+		for (unsigned int i = 0; i < numCurves; i++) {
+			Curve* curve = CurveLoader::NewCurve(*job->file, job->input.c_str(), records, i);
+			if (curve == nullptr) continue;
+			job->curves.push_back(std::unique_ptr<Curve>(curve));
+			loaded.push_back(&records[i]);
+		}
+		if (job->curves.empty()) { Finish(*job); return; }
+		job->remaining = (int)job->curves.size();
+		for (size_t i = 0; i < job->curves.size(); i++) {
+			const CurveFileRecord* record = loaded[i];
+			pool.submit([this, job, i, record](int) {
+				Curve* curve = job->curves[i].get();
+				CurveLoader::View(curve, job->file, *record, 0, (size_t)record->numPoints);
+				curve->Tessellate();
+				frameArena().reset();	// the scratch memory of the worker thread
+				curvesDone++;
+				if (--job->remaining == 0) Finish(*job);
+			}, worker);
+		}
+	}
+
+public:
+	int Run(int argc, char * argv[]) {
+		const char* inputDirectory = nullptr;
+		const char* outputDirectory = nullptr;
+		int numThreads = 0;
+		for (int i = 1; i < argc; i++) {
+			if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) inputDirectory = argv[++i];
+			else if (strcmp(argv[i], "--svg") == 0) svg = true;
+			else if (strcmp(argv[i], "--raw") == 0) svg = false;
+			else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) outputDirectory = argv[++i];
+			else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) numThreads = atoi(argv[++i]);
+		}
+		if (inputDirectory == nullptr) {
+			printf("Usage: --batch directory [--svg | --raw] [--out directory] [--threads n]\n");
+			return 1;
+		}
+		if (outputDirectory == nullptr) outputDirectory = inputDirectory;
+
+		WorkStealingPool pool(numThreads);
+		int numFiles = 0;
+		for (const std::string& name : listDirectory(inputDirectory)) {
+			if (name.size() < 4 || name.compare(name.size() - 4, 4, ".crv") != 0) continue;
+			std::shared_ptr<Job> job = std::make_shared<Job>();
+			job->input = std::string(inputDirectory) + "/" + name;
+			job->output = std::string(outputDirectory) + "/" + name.substr(0, name.size() - 4) + (svg ? ".svg" : ".raw");
+			pool.submit([this, job, &pool](int worker) { OpenFile(job, pool, worker); });
+			numFiles++;
+		}
+		if (numFiles == 0) {
+			printf("There are no .crv files in %s\n", inputDirectory);
+			return 1;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		pool.run();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		printf("%lld of %d files, %lld curves, %lld samples in %.3f sec on %d threads (%lld tasks stolen)\n",
+			(long long)filesDone, numFiles, (long long)curvesDone, (long long)samplesDone, seconds, pool.size(), (long long)pool.stolen);
+		printf("%.1f files/sec, %.0f samples/sec\n", filesDone / seconds, samplesDone / seconds);
+		return filesFailed > 0 ? 1 : 0;
+	}
+};
+
+// A Lagrange or Bezier curve evaluated in long double precision by algorithms that stay accurate at high degrees,
+// to measure the error of the other evaluations against: de Casteljau for Bezier curves, O(n^2) per sample, and the
+// second barycentric form for Lagrange curves, whose weights are kept relative to the largest so they do not underflow.
+class ReferenceCurve {
+	const PolynomialCurve* curve;
+	std::vector<long double> w;		// barycentric weights of the Lagrange knots
+	std::vector<long double> bx, by;	// de Casteljau steps
+
+public:
+	ReferenceCurve(const PolynomialCurve* _curve) : curve(_curve) {
+		if (curve->Type() != CURVE_LAGRANGE) return;
+		const std::vector<float>& ts = curve->ts;
+		int n = (int)ts.size(), largest = INT_MIN, e;
+		std::vector<int> exponents(n);
+		w.resize(n);
+		for (int i = 0; i < n; i++) { // 1 / prod (t_i - t_j) as a mantissa and an exponent
+			long double product = 1;
+			exponents[i] = 0;
+			for (int j = 0; j < n; j++) {
+				if (j == i) continue;
+				product *= (long double)ts[i] - ts[j];
+				if ((j & 31) == 31) { product = frexpl(product, &e); exponents[i] += e; }
+			}
+			product = frexpl(product, &e);
+			w[i] = 1 / product;
+			exponents[i] = -(exponents[i] + e);
+			largest = std::max(largest, exponents[i]);
+		}
+		for (int i = 0; i < n; i++) w[i] = ldexpl(w[i], exponents[i] - largest);
+	}
+
+	void Evaluate(float t, long double& x, long double& y) {
+		const float* xs = curve->controlPoints.xs();
+		const float* ys = curve->controlPoints.ys();
+		int n = (int)curve->controlPoints.size();
+		if (curve->Type() == CURVE_BEZIER) {
+			long double u = t, v = 1 - u;	// 1 - t in floats would not sum to 1 with t, n steps would grow the error n times
+			bx.assign(xs, xs + n); by.assign(ys, ys + n);
+			for (int r = 1; r < n; r++)
+				for (int i = 0; i < n - r; i++) { bx[i] = v * bx[i] + u * bx[i + 1]; by[i] = v * by[i] + u * by[i + 1]; }
+			x = bx[0]; y = by[0];
+			return;
+		}
+		long double sx = 0, sy = 0, sw = 0;
+		for (int i = 0; i < n; i++) {
+			if (t == curve->ts[i]) { x = xs[i]; y = ys[i]; return; }
+			long double c = w[i] / ((long double)t - curve->ts[i]);
+			sx += c * xs[i]; sy += c * ys[i]; sw += c;
+		}
+		x = sx / sw; y = sy / sw;
+	}
+};
+
+// Times the samples of Lagrange and Bezier curves of up to 10^4 control points evaluated term by term and from their
+// Chebyshev series, and prints the error of the series relative to the largest coordinate, against a long double
+// reference on the samples that fit into two seconds, spread over the whole range. The term by term evaluation of
+// the larger Lagrange curves is timed on the samples that fit into two seconds and extrapolated, the control points
+// are a noisy sine wave.
+// The knots of the Lagrange curves are Chebyshev points, the knots added by clicking make interpolation of more than
+// a few dozen points so ill-conditioned that no evaluation in double precision is accurate.
+int BenchmarkEvaluation() {
+	const int numSamples = 1024;
+	printf("%-9s %6s %14s %10s %10s %12s %8s %19s\n", "curve", "points", "term by term", "fit", "Clenshaw", "multipoint", "length", "relative error");
+	for (int type = 0; type < 2; type++) {
+		for (int n : { 10, 30, 100, 1000, 10000 }) {
+			frameArena().reset();	// the scratch memory of the previous curve
+			std::unique_ptr<PolynomialCurve> curve(type == 0 ? (PolynomialCurve*)new Lagrange() : (PolynomialCurve*)new Bezier());
+			srand(1);
+			for (int i = 0; i < n; i++) {
+				curve->controlPoints.push_back(vec3(-10 + 20.0f * i / n, 5 * sinf(6.0f * i / n) + (rand() % 1000) / 1000.0f, 0));
+				curve->ts.push_back((float)(1 - cos(M_PI * (i + 0.5) / n)) / 2);
+			}
+			float tStart, tEnd;
+			curve->ParameterRange(tStart, tEnd);
+			std::vector<vec3> terms(numSamples), series(numSamples);
+			auto seconds = [](std::chrono::steady_clock::time_point start) { return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(); };
+
+			curve->termByTerm = true;
+			curve->FitSeries();
+			auto start = std::chrono::steady_clock::now();
+			int numTimed = 0;
+			for (; numTimed < numSamples && (numTimed < 4 || seconds(start) < 2); numTimed++)
+				terms[numTimed] = curve->r(tStart + (tEnd - tStart) * numTimed / (numSamples - 1));
+			double termMsec = seconds(start) * 1000 * numSamples / numTimed;
+
+			curve->termByTerm = false;
+			start = std::chrono::steady_clock::now();
+			bool fitted = curve->FitSeries();
+			double fitMsec = seconds(start) * 1000;
+			if (!fitted) {
+				printf("%-9s %6d %13.3f%s %10.3f  the series would not be accurate\n", type == 0 ? "Lagrange" : "Bezier", n, termMsec,
+					numTimed < numSamples ? "~" : " ", fitMsec);
+				continue;
+			}
+			start = std::chrono::steady_clock::now();
+			for (int k = 0; k < numSamples; k++) series[k] = curve->r(tStart + (tEnd - tStart) * k / (numSamples - 1));
+			double clenshawMsec = seconds(start) * 1000;
+			int m = numSamples;
+			while (m < curve->Series().Degree()) m <<= 1;
+			FrameVector<vec3> points;
+			start = std::chrono::steady_clock::now();
+			curve->Series().EvaluateAtChebyshevPoints(m, points);
+			double multipointMsec = seconds(start) * 1000;
+
+			ReferenceCurve reference(curve.get());
+			long double error = 0, largest = 0;
+			start = std::chrono::steady_clock::now();
+			int numChecked = 0;
+			for (; numChecked < numSamples && (numChecked < 4 || seconds(start) < 2); numChecked++) {
+				int k = numChecked * 633 % numSamples;	// the stride is prime to the number of samples
+				long double x, y;
+				reference.Evaluate(tStart + (tEnd - tStart) * k / (numSamples - 1), x, y);
+				error = fmaxl(error, fmaxl(fabsl(series[k].x - x), fabsl(series[k].y - y)));
+				largest = fmaxl(largest, fmaxl(fabsl(x), fabsl(y)));
+			}
+			char relative[32] = "-";
+			if (largest > 0) snprintf(relative, sizeof(relative), "%.3Lg%s", error / largest, numChecked < numSamples ? "~" : "");
+			printf("%-9s %6d %13.3f%s %10.3f %10.3f %12.3f %8d %19s\n", type == 0 ? "Lagrange" : "Bezier", n, termMsec,
+				numTimed < numSamples ? "~" : " ", fitMsec, clenshawMsec, multipointMsec, curve->Series().Degree() + 1, relative);
+		}
+	}
+	printf("msec for %d samples, the multipoint evaluation gives at least as many at the Chebyshev points\n", numSamples);
+	return 0;
+}
+
+int onBatch(int argc, char * argv[]) {
+	for (int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "--benchmark") == 0) return BenchmarkEvaluation();
+	BatchExporter exporter;
+	return exporter.Run(argc, argv);
+}
+
+// Initialization, create an OpenGL context
+void onInitialization() {
+	if (softwareRendering()) backend.reset(new SoftwareBackend());
+	else backend.reset(new GLBackend());
+	backend->create();
+
+	printf("\nUsage: \n");
+	printf("Mouse Left Button: Add control point to polyline\n");
+	printf("Mouse Right Button: Select control point, drag to move it\n");
+	printf("Key 'P': Camera pan -x\n");
+	printf("Key 'p': Camera pan +x\n");
+	printf("Key 'Z': Camera zoom in\n");
+	printf("Key 'z': Camera zoom out\n");
+	printf("Key 'b': Begin a new Bezier curve\n");
+	printf("Key 'l': Begin a new Lagrange curve\n");
+	printf("Key 'c': Begin a new CatmullRom spline\n");
+	printf("Key 'n': Begin a new NURBS curve\n");
+	printf("Key 'W'/'w': Increase / decrease the weight of the NURBS control point under the cursor\n");
+	printf("Key 'k': Insert a knot into the NURBS near the control point under the cursor\n");
+	printf("Key 'd': Delete the curve being edited\n");
+	printf("Key 'm': Start or stop a marker moving along the curve being edited at constant speed\n");
+	printf("Key 'f': Replace the curve being edited with cubic pieces fitted to its control points\n");
+	printf("Key 'j': Switch between round and mitered line joins\n");
+	printf("Key 'J': Switch between round, butt and square line caps\n");
+	printf("Key '+'/'-': Make the lines wider / thinner\n");
+	printf("Key 'i': Print where the curves cross themselves and each other\n");
+	printf("Key 'I': Print where the curves cross the horizontal line through the cursor\n");
+	printf("Key 'g': Print the GL state calls issued and skipped in the last frame\n");
+	printf("Key 'a': Start or stop counting the heap allocations of every frame, then print the worst frame\n");
+	printf("Key 's': Start or stop streaming points into a new sliding window CatmullRom spline\n");
+	printf("Key 'S': Save the curves to session.crv\n");
+	printf("Key 'L': Load the curves of session.crv\n");
+	printf("Key 'o': Profile the frames and show the phase times, again to hide them and print the histograms\n");
+	printf("Key 'O': Start or stop writing the profile into profile.csv\n");
+	printf("Key 'T': CatmullRom spline tension increase by 0.1\n");
+	printf("Key 't': CatmullRom spline tension decrease by 0.1\n");
+	printf("Key 'v': Simplify the strips to a fraction of a pixel before drawing them, again to print how many vertices it saved\n");
+	printf("Key 'e': Evaluate the Lagrange or Bezier curve being edited term by term or from its Chebyshev series\n");
+}
+
+// Window has become invalid: Redraw
+void onDisplay() {
+	backend->Draw();
+	glState().endFrame();
+	allocationTracker().endFrame();
+	profiler().endFrame();
+	frameArena().reset();								// the scratch data of the frame is not needed any more
+	swapBuffers();										// exchange the two buffers
+}
+
+const float fitTolerance = 0.025f; // half a pixel at the initial zoom
+
+void DeleteCurve(Curve* curve) { // remove it from the scene and from whatever feeds it
+	curveLoader.Forget(curve);
+	if (ingestor.curve == curve) ingestor.Stop();
+	marker.Forget(curve);
+	if (!marker.IsRunning()) scene.SetMarker(false);
+	scene.Remove(curve);
+}
+
+// print the crossings of every curve with itself and with the others, or with the horizontal line through
+// the world space point at if there is one
+void ReportIntersections(const vec2* at = nullptr) {
+	auto start = std::chrono::steady_clock::now();
+	CurveIntersector intersector;
+	std::vector<CurveIntersector::Polyline> lines;
+	for (const auto& curve : scene.Curves()) lines.push_back(intersector.Sample(curve.get()));
+	int numSegments = 0, numFound = 0, numSwept = 0;
+	for (const auto& line : lines) numSegments += line.NumSegments();
+	auto report = [&](const std::vector<Intersection>& hits, int i, int j) { // j < 0 for the line
+		for (size_t k = 0; k < hits.size() && k < 8; k++) {
+			if (j < 0) printf("Curve %d at t = %g crosses the line at (%g, %g)\n", i, hits[k].t1, hits[k].point.x, hits[k].point.y);
+			else printf("Curve %d at t = %g crosses curve %d at t = %g at (%g, %g)\n", i, hits[k].t1, j, hits[k].t2, hits[k].point.x, hits[k].point.y);
+		}
+		if (hits.size() > 8) printf("... and %d more\n", (int)hits.size() - 8);
+		numFound += (int)hits.size();
+		if (intersector.usedSweep) numSwept++;
+	};
+	for (size_t i = 0; i < lines.size(); i++) {
+		if (at != nullptr) report(intersector.IntersectLine(lines[i], *at, *at + vec2(1, 0)), (int)i, -1);
+		else for (size_t j = i; j < lines.size(); j++) report(intersector.Intersect(lines[i], lines[j]), (int)i, (int)j);
+	}
+	double msec = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	printf("%d intersections of %d curves with %d segments in %.1f msec%s\n", numFound, (int)lines.size(), numSegments, msec,
+		numSwept > 0 ? ", tangled curves were swept" : "");
+}
+
+// Key of ASCII code pressed
+void onKeyboard(unsigned char key, int pX, int pY) {
+	ProfileScope scope("input");
+	switch (key) {
+	case 'p': camera.Pan(vec2(-1, 0)); printf("Camera moved to the left 1 meter\n"); break;
+	case 'P': camera.Pan(vec2(+1, 0)); printf("Camera moved to the right 1 meter\n"); break;
+
+	case 'g': printf("GL state calls in the last frame: %u issued, %u skipped\n", glState().lastIssued, glState().lastSkipped); break;
+	case 'a':
+		if (allocationTracker().enabled) {
+			allocationTracker().stop();
+			allocationTracker().printReport();
+		}
+		else {
+			allocationTracker().start();
+			printf("Counting the heap allocations of every frame\n");
+		}
+		break;
+
+	case 's':
+		if (ingestor.IsRunning()) {
+			ingestor.Stop();
+			printf("Streaming stopped, %llu points dropped because the queue was full\n", (unsigned long long)ingestor.dropped);
+		}
+		else ingestor.Start((StreamingCatmullRom*)scene.Add(new StreamingCatmullRom()));
+		break;
+	case 'S':
+		if (SaveCurves("session.crv", scene.Curves())) printf("Curves saved to session.crv\n");
+		else printf("Cannot write session.crv\n");
+		break;
+	case 'L':
+		if (curveLoader.Open("session.crv", scene)) printf("Loading the curves of session.crv\n");
+		break;
+
+	case 'o':
+		profilerOverlay.visible = profiler().enabled = !profiler().enabled;
+		if (!profiler().enabled) profiler().printReport();
+		break;
+	case 'O':
+		if (profiler().isWritingCSV()) {
+			profiler().stopCSV();
+			printf("Profile written to profile.csv\n");
+		}
+		else if (profiler().startCSV("profile.csv")) {
+			profiler().enabled = true;
+			printf("Writing the profile to profile.csv\n");
+		}
+		break;
+
+	case 'Z': camera.Zoom(1.1f); printf("Zoomed out\n"); break;
+	case 'z': camera.Zoom(1/1.1); printf("Zoomed in\n"); break;
+
+	//the previous curves stay in the scene, the new one receives the clicks
+	case 'b':
 		printf("Begin drawing Bezier\n");
-		lagrange.Clear();
-		catmullrom.Clear();
+		scene.Add(new Bezier());
 		break;
-	case 'l': currentCurve = LAGRANGE;
+	case 'l':
 		printf("Begin drawing Lagrange\n");
-		bezier.Clear();
-		catmullrom.Clear();
+		scene.Add(new Lagrange());
 		break;
-	case 'c': currentCurve = CATMULLROM;
+	case 'c':
 		printf("Begin drawing Catmull-Rom\n");
-		lagrange.Clear();
-		bezier.Clear();
+		scene.Add(new CatmullRom());
+		break;
+	case 'n':
+		printf("Begin drawing NURBS\n");
+		scene.Add(new BSpline());
+		break;
+
+	case 'W': case 'w': if (BSpline* bspline = dynamic_cast<BSpline*>(scene.Active())) {
+			int i = bspline->hoveredPointIndex;
+			if (i < 0) break;
+			curveLoader.Finish(bspline);
+			bspline->SetWeight(i, bspline->weights[i] * (key == 'W' ? 1.25f : 0.8f));
+			printf("Weight of control point %d is now %f\n", i, bspline->weights[i]);
+		}
+		break;
+	case 'k': if (BSpline* bspline = dynamic_cast<BSpline*>(scene.Active())) {
+			if (bspline->NumSpans() == 0) break;
+			curveLoader.Finish(bspline);
+			// in the middle of the span where the control point under the cursor pulls, or of the middle span
+			int i = bspline->hoveredPointIndex;
+			float u = i >= 0 ? bspline->Greville(i) : bspline->knots.back() / 2;
+			int k = (int)(std::upper_bound(bspline->knots.begin(), bspline->knots.end(), u) - bspline->knots.begin()) - 1;
+			k = std::min(std::max(k, bspline->Degree()), (int)bspline->controlPoints.size() - 1);
+			if (bspline->InsertKnot((bspline->knots[k] + bspline->knots[k + 1]) / 2))
+				printf("Knot inserted, the NURBS has %d control points\n", (int)bspline->controlPoints.size());
+			else printf("Knots can be inserted once the NURBS has 4 control points\n");
+		}
+		break;
+
+	case 'm':
+		if (marker.IsRunning()) {
+			marker.Stop();
+			scene.SetMarker(false);
+			printf("Marker stopped\n");
+		}
+		else if (scene.Active() != nullptr) {
+			marker.Start(scene.Active(), elapsedTime());
+			printf("Marker moves along the curve at %g units/sec\n", marker.speed);
+		}
+		break;
+
+	case 'd': if (scene.Active() != nullptr) {
+			DeleteCurve(scene.Active());
+			printf("Curve deleted, the previous curve is edited again\n");
+		}
+		break;
+	case 'j': {
+			WideLineRenderer& lines = scene.Lines();
+			lines.join = (lines.join == JOIN_ROUND) ? JOIN_MITER : JOIN_ROUND;
+			printf("Line joins are now %s\n", lines.join == JOIN_ROUND ? "round" : "mitered");
+		}
+		break;
+	case 'J': {
+			WideLineRenderer& lines = scene.Lines();
+			lines.cap = (LineCap)((lines.cap + 1) % 3);
+			printf("Line caps are now %s\n", lines.cap == CAP_ROUND ? "round" : lines.cap == CAP_BUTT ? "butt" : "square");
+		}
+		break;
+	case '+': scene.Lines().width += 1; printf("Lines are %g pixels wide\n", scene.Lines().width); break;
+	case '-': scene.Lines().width = std::max(1.0f, scene.Lines().width - 1); printf("Lines are %g pixels wide\n", scene.Lines().width); break;
+
+	case 'i': ReportIntersections(); break;
+	case 'I': {
+			vec4 wCursor = vec4(2.0f * pX / windowWidth - 1, 1.0f - 2.0f * pY / windowHeight, 0, 1) * camera.Pinv() * camera.Vinv();
+			vec2 at(wCursor.x, wCursor.y);
+			ReportIntersections(&at);
+		}
 		break;
 
-	case 'T': catmullrom.tension += 0.1f;
-		catmullrom.Recalculate();
-		printf("Tension increased by 0.1\n");
+	case 'f': if (scene.Active() != nullptr && scene.Active()->controlPoints.size() >= 2) {
+			curveLoader.Finish(scene.Active());
+			Curve* fitted = FitCurve(scene.Active(), fitTolerance);
+			DeleteCurve(scene.Active());
+			scene.Add(fitted);
+		}
 		break;
-	case 't': catmullrom.tension -= 0.1f;
-		catmullrom.Recalculate();
-		printf("Tension decreased by 0.1\n");
+
+	case 'T': if (CatmullRom* catmullrom = dynamic_cast<CatmullRom*>(scene.Active())) {
+			curveLoader.Finish(catmullrom);
+			catmullrom->tension += 0.1f;
+			catmullrom->Recalculate();
+			printf("Tension increased by 0.1\n");
+		}
 		break;
+	case 't': if (CatmullRom* catmullrom = dynamic_cast<CatmullRom*>(scene.Active())) {
+			curveLoader.Finish(catmullrom);
+			catmullrom->tension -= 0.1f;
+			catmullrom->Recalculate();
+			printf("Tension decreased by 0.1\n");
+		}
+		break;
+	case 'e': if (PolynomialCurve* polynomial = dynamic_cast<PolynomialCurve*>(scene.Active())) {
+			polynomial->termByTerm = !polynomial->termByTerm;
+			polynomial->dirty = true;
+			printf(polynomial->termByTerm ? "Evaluating the curve term by term\n" : "Evaluating the curve from its Chebyshev series\n");
+		}
+		break;
+	case 'v': {
+		long long tessellated, drawn;
+		scene.VertexCounts(tessellated, drawn);
+		if (scene.simplify) printf("Strips drawn as tessellated, simplified they had %lld of %lld vertices, %.1f times fewer\n",
+			drawn, tessellated, drawn > 0 ? (double)tessellated / drawn : 1.0);
+		else printf("Strips simplified to %g pixels before they are drawn\n", CurveScene::simplifyPixels);
+		scene.simplify = !scene.simplify;
+		break;
+	}
 	}
-	glutPostRedisplay();
+	refreshScreen();
 }
 
 // Key of ASCII code released
@@ -438,53 +3720,71 @@ void onKeyboardUp(unsigned char key, int pX, int pY) {
 
 // Mouse click event
 void onMouse(int button, int state, int pX, int pY) {
+	ProfileScope scope("input");
 	float cX = 2.0f * pX / windowWidth - 1;	// flip y axis
 	float cY = 1.0f - 2.0f * pY / windowHeight;
 
-	if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {  // GLUT_LEFT_BUTTON / GLUT_RIGHT_BUTTON and GLUT_DOWN / GLUT_UP
+	Curve* curve = scene.Active();
+	if (curve == nullptr) return;
 
-		switch (currentCurve) {
-		case BEZIER: bezier.AddPoint(cX, cY);  printf("Point added at: %f, %f\n", cX, cY);  break;
-		case LAGRANGE: lagrange.AddPoint(cX, cY);  printf("Point added at: %f, %f\n", cX, cY);  break;
-		case CATMULLROM: catmullrom.AddPoint(cX, cY);   printf("Point added at: %f, %f\n", cX, cY); break;
-		case NONE: break;
-		}
+	if (state == GLUT_DOWN) curveLoader.Finish(curve); // a click adds or drags a point
+	if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) {  // GLUT_LEFT_BUTTON / GLUT_RIGHT_BUTTON and GLUT_DOWN / GLUT_UP
+		curve->AddPoint(cX, cY);
+		printf("Point added at: %f, %f\n", cX, cY);
 	}
 	else if (button == GLUT_RIGHT_BUTTON && state == GLUT_DOWN) {
-
-		switch (currentCurve) {
-		case BEZIER: bezier.selectedPointIndex = bezier.ClosestIndex(cX, cY);   break;
-		case LAGRANGE: lagrange.selectedPointIndex = lagrange.ClosestIndex(cX, cY);  break;
-		case CATMULLROM: catmullrom.selectedPointIndex = catmullrom.ClosestIndex(cX, cY);  break;
-		case NONE: break;
-		}
+		curve->selectedPointIndex = curve->ClosestIndex(cX, cY);
+		scene.RefreshPointState(curve->selectedPointIndex);
 	}
 	else if (state == GLUT_UP) {
-		switch (currentCurve) {
-		case BEZIER: bezier.selectedPointIndex = -1;   break;
-		case LAGRANGE: lagrange.selectedPointIndex = -1;  break;
-		case CATMULLROM: catmullrom.selectedPointIndex = -1;  break;
-		case NONE: break;
-		}
+		int released = curve->selectedPointIndex;
+		curve->selectedPointIndex = -1;
+		scene.RefreshPointState(released);
 	}
-	glutPostRedisplay();     // redraw
+	refreshScreen();     // redraw
 }
 
 // Move mouse with key pressed
 void onMouseMotion(int pX, int pY) {
+	ProfileScope scope("input");
 
 	float cX = 2.0f * pX / windowWidth - 1;	// flip y axis
 	float cY = 1.0f - 2.0f * pY / windowHeight;
-	switch (currentCurve) {
-	case BEZIER:  bezier.UpdatePoint(cX, cY, bezier.selectedPointIndex);  break;
-	case LAGRANGE:  lagrange.UpdatePoint(cX, cY, lagrange.selectedPointIndex); break;
-	case CATMULLROM:  catmullrom.UpdatePoint(cX, cY, catmullrom.selectedPointIndex); break;
-	case NONE: break;
-	}
-	glutPostRedisplay();     // redraw
+
+	Curve* curve = scene.Active();
+	if (curve != nullptr) curve->UpdatePoint(cX, cY, curve->selectedPointIndex);
+	refreshScreen();     // redraw
+}
+
+// Move mouse without key pressed
+void onMousePassiveMotion(int pX, int pY) {
+	ProfileScope scope("input");
+	float cX = 2.0f * pX / windowWidth - 1;	// flip y axis
+	float cY = 1.0f - 2.0f * pY / windowHeight;
+
+	Curve* curve = scene.Active();
+	if (curve == nullptr) return;
+	int hovered = curve->ClosestIndex(cX, cY);
+	if (hovered == curve->hoveredPointIndex) return;
+	int previous = curve->hoveredPointIndex;
+	curve->hoveredPointIndex = hovered;
+	scene.RefreshPointState(previous);
+	scene.RefreshPointState(hovered);
+	refreshScreen();     // redraw
 }
 
 // Idle event indicating that some time elapsed: do animation here
 void onIdle() {
-	long time = glutGet(GLUT_ELAPSED_TIME); // elapsed time since the start of the program
+	long time = elapsedTime(); // elapsed time since the start of the program
+	if (curveLoader.LoadMore()) refreshScreen(); // show the next chunk of the curves being loaded
+	if (ingestor.Drain() > 0) refreshScreen(); // points that arrived from the stream
+	if (marker.IsRunning()) {
+		scene.SetMarker(true, marker.Advance(time));
+		refreshScreen();
+	}
+}
+
+// Headless replay: nothing would change any more without input, the animation of the marker does not count
+bool onSettled() {
+	return !curveLoader.IsLoading() && !ingestor.IsRunning() && !scene.Dirty();
 }
@@ -52,6 +52,7 @@ public:
 
 Camera camera;		// 2D camera
 GPUProgram gpuProgram;	// vertex and fragment shaders
+UniformHandle mvpUniform;	// MVP of gpuProgram, resolved once after it is created
 
 //this class was called LineStrip in the base program, I modified to fit the Curve
 class Curve {
@@ -137,7 +138,7 @@ public:
 
 			// set GPU uniform matrix variable MVP with the content of CPU variable MVPTransform
 			mat4 MVPTransform = M() * camera.V() * camera.P();
-			gpuProgram.setUniform(MVPTransform, "MVP");
+			gpuProgram.setUniform(MVPTransform, mvpUniform);
 
 			// draw the curve
 			glBindVertexArray(vao);
@@ -290,7 +291,7 @@ public:
 
 			// set GPU uniform matrix variable MVP with the content of CPU variable MVPTransform
 			mat4 MVPTransform = M() * camera.V() * camera.P();
-			gpuProgram.setUniform(MVPTransform, "MVP");
+			gpuProgram.setUniform(MVPTransform, mvpUniform);
 
 			// draw the curve
 			glBindVertexArray(vao);
@@ -346,6 +347,7 @@ void onInitialization() {
 
 	// create program for the GPU
 	gpuProgram.create(vertexSource, fragmentSource, "fragmentColor");
+	mvpUniform = gpuProgram.getUniform("MVP");
 
 	printf("\nUsage: \n");
 	printf("Mouse Left Button: Add control point to polyline\n");
@@ -373,7 +375,7 @@ void onDisplay() {
 		case CATMULLROM: catmullrom.Draw(); break;
 	}
 
-	glutSwapBuffers();									// exchange the two buffers
+	swapBuffers();										// exchange the two buffers
 }
 
 // Key of ASCII code pressed
@@ -405,7 +407,7 @@ void onKeyboard(unsigned char key, int pX, int pY) {
 				catmullrom.Recalculate();
 				break;
 }
-	glutPostRedisplay();
+	refreshScreen();
 }
 
 // Key of ASCII code released
@@ -431,7 +433,7 @@ void onMouse(int button, int state, int pX, int pY) {
 	}
 
 
-	glutPostRedisplay();     // redraw
+	refreshScreen();     // redraw
 }
 
 // Move mouse with key pressed
@@ -440,13 +442,28 @@ void onMouseMotion(int pX, int pY) {
 		float cX = 2.0f * pX / windowWidth - 1;	// flip y axis
 		float cY = 1.0f - 2.0f * pY / windowHeight;
 		
-		glutPostRedisplay();     // redraw
+		refreshScreen();     // redraw
 	
 }
 
+// Move mouse without key pressed
+void onMousePassiveMotion(int pX, int pY) {
+}
+
 // Idle event indicating that some time elapsed: do animation here
 void onIdle() {
-	long time = glutGet(GLUT_ELAPSED_TIME); // elapsed time since the start of the program
+	long time = elapsedTime(); // elapsed time since the start of the program
 	float sec = time / 1000.0f;				// convert msec to sec
-	//glutPostRedisplay();					// redraw the scene
+	//refreshScreen();					// redraw the scene
+}
+
+// Headless replay: nothing changes without input
+bool onSettled() {
+	return true;
+}
+
+// Batch mode (--batch, --benchmark): the sample has nothing to process without a window
+int onBatch(int argc, char * argv[]) {
+	printf("This program has no batch mode\n");
+	return 1;
 }
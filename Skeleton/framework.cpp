@@ -4,6 +4,22 @@
 // Do not change it if you want to submit a homework.
 //=============================================================================================
 #include "framework.h"
+#include <chrono>
+
+#if defined(__linux__)
+#define EGL_EGL_PROTOTYPES 0	// libEGL is loaded by headless mode, a window does not need it
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <dlfcn.h>			// dlopen, link with -ldl before glibc 2.34
+#endif
+#if defined(__APPLE__)
+#include <malloc/malloc.h>	// malloc_size
+#else
+#include <malloc.h>			// malloc_usable_size, _msize
+#endif
+#if defined(_WIN32)
+#include <io.h>				// _isatty
+#endif
 
 // Initialization
 void onInitialization();
@@ -26,9 +42,532 @@ void onMouse(int button, int state, int pX, int pY);
 // Idle event indicating that some time elapsed: do animation here
 void onIdle();
 
+// Move mouse without key pressed
+void onMousePassiveMotion(int pX, int pY);
+
+// Headless replay: nothing would change any more without input, so no more frames are needed after the last event
+bool onSettled();
+
+// Batch mode (--batch, --benchmark): process files or time the algorithms without a window or an OpenGL context,
+// returns the exit code
+int onBatch(int argc, char * argv[]);
+
+static bool headless = false;	// rendering into a framebuffer object without a window
+static bool software = false;	// headless without OpenGL, onDisplay draws into softwarePixels
+static std::vector<unsigned char> softwarePixels;
+static std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+static bool redisplayRequested = false;	// refreshScreen was called since the last frame
+static bool windowShown = false;		// GLUT runs the application in a window
+
+void refreshScreen() {
+	if (headless) redisplayRequested = true;
+	else glutPostRedisplay();
+}
+
+void swapBuffers() { if (!headless) glutSwapBuffers(); }
+
+bool softwareRendering() { return software; }
+
+bool interactive() {
+#if defined(_WIN32)
+	return windowShown && _isatty(_fileno(stdin));
+#else
+	return windowShown && isatty(fileno(stdin));
+#endif
+}
+
+unsigned char* softwareFramebuffer() {
+	if (softwarePixels.empty()) softwarePixels.resize(windowWidth * windowHeight * 4);
+	return &softwarePixels[0];
+}
+
+long elapsedTime() {
+	return (long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+#if defined(__linux__)
+// the functions of libEGL that headless mode calls, looked up when it starts
+static struct {
+	PFNEGLGETPROCADDRESSPROC getProcAddress;
+	PFNEGLGETDISPLAYPROC getDisplay;
+	PFNEGLINITIALIZEPROC initialize;
+	PFNEGLBINDAPIPROC bindAPI;
+	PFNEGLCREATECONTEXTPROC createContext;
+	PFNEGLMAKECURRENTPROC makeCurrent;
+	PFNEGLDESTROYCONTEXTPROC destroyContext;
+	PFNEGLTERMINATEPROC terminate;
+} egl;
+
+static bool loadEGL() {
+	void* library = dlopen("libEGL.so.1", RTLD_NOW | RTLD_GLOBAL);
+	if (library == nullptr) {
+		printf("Headless mode needs libEGL.so.1: %s\n", dlerror());
+		return false;
+	}
+	bool found = true;
+	auto load = [&](const char* name) { void* function = dlsym(library, name); found = found && function != nullptr; return function; };
+	egl.getProcAddress = (PFNEGLGETPROCADDRESSPROC)load("eglGetProcAddress");
+	egl.getDisplay = (PFNEGLGETDISPLAYPROC)load("eglGetDisplay");
+	egl.initialize = (PFNEGLINITIALIZEPROC)load("eglInitialize");
+	egl.bindAPI = (PFNEGLBINDAPIPROC)load("eglBindAPI");
+	egl.createContext = (PFNEGLCREATECONTEXTPROC)load("eglCreateContext");
+	egl.makeCurrent = (PFNEGLMAKECURRENTPROC)load("eglMakeCurrent");
+	egl.destroyContext = (PFNEGLDESTROYCONTEXTPROC)load("eglDestroyContext");
+	egl.terminate = (PFNEGLTERMINATEPROC)load("eglTerminate");
+	if (!found) printf("libEGL.so.1 lacks functions of EGL 1.4\n");
+	return found;
+}
+#endif
+
+void* getProcAddress(const char* name) {
+#if defined(__linux__)
+	if (headless) return (void*)egl.getProcAddress(name);
+#endif
+#if defined(__APPLE__)
+	return nullptr;
+#else
+	return (void*)glutGetProcAddress(name);
+#endif
+}
+
+static void printGLInfo() {
+	int majorVersion, minorVersion;
+	printf("GL Vendor    : %s\n", glGetString(GL_VENDOR));
+	printf("GL Renderer  : %s\n", glGetString(GL_RENDERER));
+	printf("GL Version (string)  : %s\n", glGetString(GL_VERSION));
+	glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
+	glGetIntegerv(GL_MINOR_VERSION, &minorVersion);
+	printf("GL Version (integer) : %d.%d\n", majorVersion, minorVersion);
+	printf("GLSL Version : %s\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
+}
+
+static bool firstFrame = true;
+
+// Draws the frame and reports how long the application took to get the first one on the screen
+static void onDisplayTimed() {
+	onDisplay();
+	if (!firstFrame) return;
+	firstFrame = false;
+	if (!software) glFinish();
+	printf("Time to first frame: %ld msec (programs from binary cache: %d, compiled: %d)\n",
+		elapsedTime(), GPUProgram::cacheStats().loaded, GPUProgram::cacheStats().compiled);
+}
+
+// Writes the frame buffer into a 32 bit bmp file, glReadPixels already gives the bottom-up BGRA rows of the format
+static void dumpFrame(const char* pathname) {
+	static std::vector<unsigned char> pixels;	// kept, the dump should not allocate in the frames it measures
+	pixels.resize(windowWidth * windowHeight * 4);
+	if (software) {	// only red and blue are swapped
+		const unsigned char* rgba = softwareFramebuffer();
+		for (size_t i = 0; i < pixels.size(); i += 4) {
+			pixels[i] = rgba[i + 2]; pixels[i + 1] = rgba[i + 1]; pixels[i + 2] = rgba[i]; pixels[i + 3] = rgba[i + 3];
+		}
+	}
+	else glReadPixels(0, 0, windowWidth, windowHeight, GL_BGRA, GL_UNSIGNED_BYTE, &pixels[0]);
+	unsigned char header[54] = { 'B', 'M' };
+	auto put = [&header](int offset, unsigned int value, int bytes) {
+		for (int i = 0; i < bytes; i++) header[offset + i] = (unsigned char)(value >> (8 * i));
+	};
+	put(2, sizeof(header) + (unsigned int)pixels.size(), 4);	// file size
+	put(10, sizeof(header), 4);		// offset of the pixels
+	put(14, 40, 4);					// size of the info header
+	put(18, windowWidth, 4);
+	put(22, windowHeight, 4);
+	put(26, 1, 2);					// planes
+	put(28, 32, 2);					// bits per pixel
+	FILE* file = fopen(pathname, "wb");
+	if (!file) {
+		printf("Cannot write %s\n", pathname);
+		return;
+	}
+	fwrite(header, 1, sizeof(header), file);
+	fwrite(&pixels[0], 1, pixels.size(), file);
+	fclose(file);
+}
+
+//---------------------------
+// Heap accounting: the global operator new and delete are replaced to count every allocation of the program
+// while countHeap is on, otherwise they only test a flag. The size of a block is asked from the C heap when it
+// is deleted, so nothing is stored next to it.
+//---------------------------
+#if defined(_WIN32)
+static size_t blockSize(void* block) { return _msize(block); }
+#elif defined(__APPLE__)
+static size_t blockSize(void* block) { return malloc_size(block); }
+#else
+static size_t blockSize(void* block) { return malloc_usable_size(block); }
+#endif
+
+static std::atomic<bool> heapCounted{ false };
+static std::atomic<long long> heapAllocations{ 0 }, heapBytes{ 0 }, heapInUse{ 0 }, heapPeak{ 0 };
+
+static void* allocateCounted(size_t size) {
+	void* block = malloc(size > 0 ? size : 1);
+	if (block == nullptr || !heapCounted.load(std::memory_order_relaxed)) return block;
+	long long bytes = (long long)blockSize(block);
+	heapAllocations.fetch_add(1, std::memory_order_relaxed);
+	heapBytes.fetch_add(bytes, std::memory_order_relaxed);
+	long long inUse = heapInUse.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	long long peak = heapPeak.load(std::memory_order_relaxed);
+	while (inUse > peak && !heapPeak.compare_exchange_weak(peak, inUse, std::memory_order_relaxed)) { }
+	return block;
+}
+
+static void freeCounted(void* block) {
+	if (block == nullptr) return;
+	if (heapCounted.load(std::memory_order_relaxed)) heapInUse.fetch_sub((long long)blockSize(block), std::memory_order_relaxed);
+	free(block);
+}
+
+void* operator new(size_t size) {
+	void* block = allocateCounted(size);
+	if (block == nullptr) throw std::bad_alloc();
+	return block;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocateCounted(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocateCounted(size); }
+void operator delete(void* block) noexcept { freeCounted(block); }
+void operator delete[](void* block) noexcept { freeCounted(block); }
+void operator delete(void* block, size_t) noexcept { freeCounted(block); }
+void operator delete[](void* block, size_t) noexcept { freeCounted(block); }
+void operator delete(void* block, const std::nothrow_t&) noexcept { freeCounted(block); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { freeCounted(block); }
+
+HeapStats heapStats() {
+	HeapStats stats;
+	stats.allocations = heapAllocations.load(std::memory_order_relaxed);
+	stats.bytes = heapBytes.load(std::memory_order_relaxed);
+	stats.inUse = heapInUse.load(std::memory_order_relaxed);
+	stats.peak = heapPeak.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void countHeap(bool enabled) { heapCounted.store(enabled, std::memory_order_relaxed); }
+
+void resetHeapPeak() { heapPeak.store(heapInUse.load(std::memory_order_relaxed), std::memory_order_relaxed); }
+
+//---------------------------
+// Input traces: the event handlers are the workload of an editing session, so they are recorded into a file
+// and fed back later through the same handlers. The file is "TRC1" followed by the 12 byte events.
+//---------------------------
+enum TraceEventType { TRACE_KEYBOARD, TRACE_KEYBOARD_UP, TRACE_MOUSE, TRACE_MOUSE_MOTION, TRACE_MOUSE_PASSIVE_MOTION };
+
+struct TraceEvent {
+	unsigned int time;			// msec since the start of the recording
+	unsigned char type;			// TraceEventType
+	unsigned char key, state;	// key or mouse button, GLUT_DOWN / GLUT_UP
+	unsigned char pad = 0;
+	short pX, pY;				// window coordinates
+};
+static_assert(sizeof(TraceEvent) == 12, "trace events are stored as 12 bytes");
+
+static const char traceMagic[4] = { 'T', 'R', 'C', '1' };
+static FILE* traceFile = nullptr;	// recording in progress
+
+static void closeTrace() { if (traceFile) fclose(traceFile); traceFile = nullptr; }
+
+static bool startRecording(const char* pathname) {
+	traceFile = fopen(pathname, "wb");
+	if (!traceFile) {
+		printf("Cannot write %s\n", pathname);
+		return false;
+	}
+	fwrite(traceMagic, 1, sizeof(traceMagic), traceFile);
+	atexit(closeTrace);	// glutMainLoop leaves with exit()
+	printf("Recording the input into %s\n", pathname);
+	return true;
+}
+
+static void record(TraceEventType type, int key, int state, int pX, int pY) {
+	TraceEvent event;
+	event.time = (unsigned int)elapsedTime();
+	event.type = (unsigned char)type;
+	event.key = (unsigned char)key;
+	event.state = (unsigned char)state;
+	event.pX = (short)pX;
+	event.pY = (short)pY;
+	fwrite(&event, sizeof(event), 1, traceFile);
+}
+
+// the handlers registered with GLUT while recording
+static void onKeyboardRecorded(unsigned char key, int pX, int pY) { record(TRACE_KEYBOARD, key, 0, pX, pY); onKeyboard(key, pX, pY); }
+static void onKeyboardUpRecorded(unsigned char key, int pX, int pY) { record(TRACE_KEYBOARD_UP, key, 0, pX, pY); onKeyboardUp(key, pX, pY); }
+static void onMouseRecorded(int button, int state, int pX, int pY) { record(TRACE_MOUSE, button, state, pX, pY); onMouse(button, state, pX, pY); }
+static void onMouseMotionRecorded(int pX, int pY) { record(TRACE_MOUSE_MOTION, 0, 0, pX, pY); onMouseMotion(pX, pY); }
+static void onMousePassiveMotionRecorded(int pX, int pY) { record(TRACE_MOUSE_PASSIVE_MOTION, 0, 0, pX, pY); onMousePassiveMotion(pX, pY); }
+
+static bool loadTrace(const char* pathname, std::vector<TraceEvent>& events) {
+	FILE* file = fopen(pathname, "rb");
+	if (!file) {
+		printf("Cannot open %s\n", pathname);
+		return false;
+	}
+	char magic[4];
+	bool valid = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, traceMagic, sizeof(magic)) == 0;
+	TraceEvent event;
+	while (valid && fread(&event, sizeof(event), 1, file) == 1) events.push_back(event);
+	fclose(file);
+	if (!valid) printf("%s is not an input trace\n", pathname);
+	return valid;
+}
+
+static void dispatch(const TraceEvent& event) {
+	switch (event.type) {
+	case TRACE_KEYBOARD: onKeyboard(event.key, event.pX, event.pY); break;
+	case TRACE_KEYBOARD_UP: onKeyboardUp(event.key, event.pX, event.pY); break;
+	case TRACE_MOUSE: onMouse(event.key, event.state, event.pX, event.pY); break;
+	case TRACE_MOUSE_MOTION: onMouseMotion(event.pX, event.pY); break;
+	case TRACE_MOUSE_PASSIVE_MOTION: onMousePassiveMotion(event.pX, event.pY); break;
+	}
+}
+
+//---------------------------
+// Headless mode: --headless [frames] [--software] [--dump directory] [--replay trace [--realtime]] [--profile csv]
+//                [--allocations]
+// Renders into a framebuffer object of an EGL context that needs no display (e.g. Mesa llvmpipe on a server)
+// and drives the event handlers as fast as possible, either with a fixed script or with a recorded trace.
+// With --software no OpenGL context is created at all, the application draws the frames on the CPU.
+// It reports the frame rate and where the CPU time of a frame went, a replay also the latency of the events.
+// With --dump every frame is written to the directory as a bmp file, with --profile the phases of the
+// application are profiled into the csv file, with --allocations the heap allocations of the frames are counted.
+//---------------------------
+#if defined(__linux__)
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLContext eglContext = EGL_NO_CONTEXT;
+#endif
+static const char* dumpDirectory = nullptr;
+
+static bool createHeadlessContext() {
+#if defined(__linux__)
+	if (!loadEGL()) return false;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)egl.getProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay) eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if (eglDisplay == EGL_NO_DISPLAY) eglDisplay = egl.getDisplay(EGL_DEFAULT_DISPLAY);
+	EGLint eglMajor, eglMinor;
+	if (!egl.initialize(eglDisplay, &eglMajor, &eglMinor) || !egl.bindAPI(EGL_OPENGL_API)) {
+		printf("Error in EGL initialization\n");
+		return false;
+	}
+	// OpenGL major and minor versions
+	int majorVersion = 3, minorVersion = 3;
+	EGLint contextAttributes[] = { EGL_CONTEXT_MAJOR_VERSION, majorVersion, EGL_CONTEXT_MINOR_VERSION, minorVersion,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+	eglContext = egl.createContext(eglDisplay, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttributes);
+	if (eglContext == EGL_NO_CONTEXT || !egl.makeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+		printf("Error in EGL context creation, EGL_KHR_surfaceless_context is required\n");
+		return false;
+	}
+	glewExperimental = true;	// magic
+	glewInit();
+	printGLInfo();
+
+	// the frame buffer of the missing window
+	unsigned int framebuffer, colorBuffer, depthBuffer;
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glGenRenderbuffers(1, &colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, windowWidth, windowHeight);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, windowWidth, windowHeight);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("Error in framebuffer creation\n");
+		return false;
+	}
+	return true;
+#else
+	printf("Headless mode needs EGL, it is only available on Linux\n");
+	return false;
+#endif
+}
+
+static void destroyHeadlessContext() {
+#if defined(__linux__)
+	egl.makeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	egl.destroyContext(eglDisplay, eglContext);
+	egl.terminate(eglDisplay);
+#endif
+}
+
+enum Phase { INPUT, IDLE, DISPLAY, FINISH, DUMP, NUM_PHASES };
+static double phaseTime[NUM_PHASES];	// msec spent in each phase during the run
+
+typedef std::chrono::steady_clock::time_point TimePoint;
+static TimePoint now() { return std::chrono::steady_clock::now(); }
+static double msec(TimePoint from, TimePoint to) { return std::chrono::duration<double, std::milli>(to - from).count(); }
+
+static void headlessIdle() {
+	auto t1 = now();
+	onIdle();
+	phaseTime[IDLE] += msec(t1, now());
+}
+
+// draws one frame and waits until it is ready
+static void headlessFrame(int frame) {
+	redisplayRequested = false;	// onIdle may ask for the next frame
+	headlessIdle();
+	auto t2 = now();
+	onDisplayTimed();
+	auto t3 = now();
+	if (!software) glFinish();
+	auto t4 = now();
+	if (dumpDirectory) {
+		char pathname[1024];
+		snprintf(pathname, sizeof(pathname), "%s/frame%05d.bmp", dumpDirectory, frame);
+		dumpFrame(pathname);
+	}
+	auto t5 = now();
+	phaseTime[DISPLAY] += msec(t2, t3);
+	phaseTime[FINISH] += msec(t3, t4);
+	phaseTime[DUMP] += msec(t4, t5);
+}
+
+static void reportPhases(int frames, double total) {
+	const char* phaseNames[NUM_PHASES] = { "input", "idle", "display", "gpu finish", "dump" };
+	printf("\nHeadless run: %d frames in %.1f msec, %.1f frames/sec\n", frames, total, frames * 1000.0 / total);
+	printf("CPU time per frame (msec):\n");
+	for (int phase = 0; phase < NUM_PHASES; phase++) {
+		if (phase == DUMP && !dumpDirectory) continue;
+		printf("  %-10s %8.3f\n", phaseNames[phase], frames > 0 ? phaseTime[phase] / frames : 0);
+	}
+}
+
+// the script: three curves of 8 control points, then one point of the last curve is dragged around
+// a circle while the cursor hovers, and a point is added every 100 frames so the layout changes too
+static void runScript(int frames) {
+	auto setup = now();
+	const char* curveKeys = "blc";
+	for (const char* key = curveKeys; *key; key++) {
+		onKeyboard(*key, 0, 0);
+		for (int i = 0; i < 8; i++) {
+			int pX = 60 + i * 65, pY = 150 + 150 * (int)(key - curveKeys) + (i % 2) * 60;
+			onMouse(GLUT_LEFT_BUTTON, GLUT_DOWN, pX, pY);
+			onMouse(GLUT_LEFT_BUTTON, GLUT_UP, pX, pY);
+		}
+	}
+	onMouse(GLUT_RIGHT_BUTTON, GLUT_DOWN, 60, 450);
+
+	auto start = now();
+	for (int frame = 0; frame < frames; frame++) {
+		auto t0 = now();
+		float angle = frame * 0.05f;
+		int pX = 300 + (int)(200 * cosf(angle)), pY = 300 + (int)(200 * sinf(angle));
+		onMouseMotion(pX, pY);
+		if (frame % 100 == 99) {
+			onMouse(GLUT_RIGHT_BUTTON, GLUT_UP, pX, pY);
+			onMouse(GLUT_LEFT_BUTTON, GLUT_DOWN, pX, 600 - pY);
+			onMouse(GLUT_LEFT_BUTTON, GLUT_UP, pX, 600 - pY);
+			onMouse(GLUT_RIGHT_BUTTON, GLUT_DOWN, pX, pY);
+		}
+		onMousePassiveMotion(600 - pX, pY);
+		auto t1 = now();
+		phaseTime[INPUT] += msec(t0, t1);
+		headlessFrame(frame);
+	}
+	reportPhases(frames, msec(start, now()));
+	printf("  (the initial script took %.1f msec)\n", msec(setup, start));
+}
+
+// Feeds the trace through the event handlers. At full speed every event that asks for a redisplay is followed
+// by a frame. In real time the events wait for their recorded time, and those that became due during a frame
+// are handled together before the next one, as GLUT would do. While waiting, onIdle runs and the frames it asks
+// for are drawn, as in the GLUT main loop. The latency of an event is measured from the
+// moment it was due to the moment the frame showing it is finished.
+static void runReplay(const std::vector<TraceEvent>& events, bool realtime) {
+	std::vector<double> latencies;
+	latencies.reserve(events.size());
+	std::vector<TimePoint> pending;	// due times of the events not shown yet
+	int frames = 0;
+	auto start = now();
+	unsigned int firstTime = events.empty() ? 0 : events[0].time;
+	auto dueTime = [&](size_t i) { return start + std::chrono::milliseconds(events[i].time - firstTime); };
+	for (size_t i = 0; i < events.size(); ) {
+		while (realtime && now() < dueTime(i)) {
+			headlessIdle();
+			if (redisplayRequested) headlessFrame(frames++);
+			else std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		// handle this event and, in real time, the later ones that are already due
+		do {
+			TimePoint due = realtime ? dueTime(i) : now();
+			auto t0 = now();
+			dispatch(events[i++]);
+			phaseTime[INPUT] += msec(t0, now());
+			pending.push_back(due);
+		} while (realtime && i < events.size() && dueTime(i) <= now());
+		if (!redisplayRequested) { pending.clear(); continue; }	// nothing changed on the screen
+		headlessFrame(frames++);
+		auto ready = now();
+		for (TimePoint eventTime : pending) latencies.push_back(msec(eventTime, ready));
+		pending.clear();
+	}
+	// frames asked for by onIdle after the last event until the scene settles, e.g. a progressive load,
+	// an endless animation alone does not keep the replay running
+	for (int settle = 0; redisplayRequested && !onSettled() && settle < 1000; settle++) headlessFrame(frames++);
+	reportPhases(frames, msec(start, now()));
+
+	printf("Replayed %d events %s, %d of them caused a frame\n", (int)events.size(), realtime ? "in real time" : "at full speed", (int)latencies.size());
+	if (latencies.empty()) return;
+	std::sort(latencies.begin(), latencies.end());
+	auto percentile = [&latencies](double p) { return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))]; };
+	printf("Event to frame ready latency (msec): p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+		percentile(0.5), percentile(0.9), percentile(0.99), latencies.back());
+}
+
+static int runHeadless(int argc, char * argv[]) {
+	int frames = 1000;
+	const char* replayPathname = nullptr;
+	const char* profilePathname = nullptr;
+	bool realtime = false, allocations = false;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) dumpDirectory = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replayPathname = argv[++i];
+		else if (strcmp(argv[i], "--realtime") == 0) realtime = true;
+		else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) profilePathname = argv[++i];
+		else if (strcmp(argv[i], "--software") == 0) software = true;
+		else if (strcmp(argv[i], "--allocations") == 0) allocations = true;
+		else if (atoi(argv[i]) > 0) frames = atoi(argv[i]);
+	}
+	std::vector<TraceEvent> events;
+	if (replayPathname && !loadTrace(replayPathname, events)) return 1;
+
+	headless = true;
+	if (software) profiler().gpuTimers = false;
+	else if (!createHeadlessContext()) return 1;
+	onInitialization();
+	if (profilePathname) {
+		if (!profiler().startCSV(profilePathname)) printf("Cannot write %s\n", profilePathname);
+		profiler().enabled = true;
+	}
+	if (allocations) allocationTracker().start();
+	if (replayPathname) runReplay(events, realtime);
+	else runScript(frames);
+	if (profilePathname) {
+		profiler().stopCSV();
+		profiler().printReport();
+	}
+	if (allocations) allocationTracker().printReport();
+	if (software) return 0;
+	if (glGetError() != GL_NO_ERROR) printf("GL error during the headless run\n");
+	destroyHeadlessContext();
+	return 0;
+}
+
 // Entry point of the application
 int main(int argc, char * argv[]) {
 	// Initialize GLUT, Glew and OpenGL 
+	const char* recordPathname = nullptr;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0 || strcmp(argv[i], "--replay") == 0) return runHeadless(argc, argv);
+		if (strcmp(argv[i], "--batch") == 0 || strcmp(argv[i], "--benchmark") == 0) return onBatch(argc, argv);
+		if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) recordPathname = argv[++i];
+	}
+
 	glutInit(&argc, argv);
 
 	// OpenGL major and minor versions
@@ -44,28 +583,33 @@ int main(int argc, char * argv[]) {
 	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
 #endif
 	glutCreateWindow(argv[0]);
+	windowShown = true;
 
 #if !defined(__APPLE__)
 	glewExperimental = true;	// magic
 	glewInit();
 #endif
-	printf("GL Vendor    : %s\n", glGetString(GL_VENDOR));
-	printf("GL Renderer  : %s\n", glGetString(GL_RENDERER));
-	printf("GL Version (string)  : %s\n", glGetString(GL_VERSION));
-	glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
-	glGetIntegerv(GL_MINOR_VERSION, &minorVersion);
-	printf("GL Version (integer) : %d.%d\n", majorVersion, minorVersion);
-	printf("GLSL Version : %s\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
+	printGLInfo();
 
 	// Initialize this program and create shaders
 	onInitialization();
 
-	glutDisplayFunc(onDisplay);                // Register event handlers
-	glutMouseFunc(onMouse);
+	glutDisplayFunc(onDisplayTimed);           // Register event handlers
 	glutIdleFunc(onIdle);
-	glutKeyboardFunc(onKeyboard);
-	glutKeyboardUpFunc(onKeyboardUp);
-	glutMotionFunc(onMouseMotion);
+	if (recordPathname && startRecording(recordPathname)) {	// --record trace: log the input for --replay
+		glutMouseFunc(onMouseRecorded);
+		glutKeyboardFunc(onKeyboardRecorded);
+		glutKeyboardUpFunc(onKeyboardUpRecorded);
+		glutMotionFunc(onMouseMotionRecorded);
+		glutPassiveMotionFunc(onMousePassiveMotionRecorded);
+	}
+	else {
+		glutMouseFunc(onMouse);
+		glutKeyboardFunc(onKeyboard);
+		glutKeyboardUpFunc(onKeyboardUp);
+		glutMotionFunc(onMouseMotion);
+		glutPassiveMotionFunc(onMousePassiveMotion);
+	}
 
 	glutMainLoop();
 	return 1;
@@ -8,9 +8,25 @@
 #define _USE_MATH_DEFINES		// M_PI
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
 #include <math.h>
+#include <errno.h>
 #include <vector>
+#include <algorithm>
 #include <string>
+#include <thread>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
+#include <new>
+#include <cstddef>
 
 #if defined(__APPLE__)
 #include <GLUT/GLUT.h>
@@ -23,9 +39,39 @@
 #include <GL/freeglut.h>	// must be downloaded unless you have an Apple
 #endif
 
+#if defined(_WIN32)
+#include <direct.h>			// _mkdir
+#else
+#include <fcntl.h>			// memory mapped files
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <poll.h>			// reading a stream that can be stopped
+#include <dirent.h>			// listDirectory
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <tmmintrin.h>		// _mm_shuffle_epi8, used only when the CPU reports SSSE3
+#if defined(_MSC_VER)
+#include <intrin.h>			// __cpuid
+#endif
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>		// 4 pixels at a time in the software renderer
+#endif
+
 // Resolution of screen
 const unsigned int windowWidth = 600, windowHeight = 600;
 
+// Window system services implemented in framework.cpp, by GLUT or without a window in headless mode
+void refreshScreen();					// request onDisplay to be called
+void swapBuffers();						// show the frame drawn by onDisplay
+long elapsedTime();						// msec since the start of the program
+void* getProcAddress(const char* name);	// entry point of a GL extension function
+bool softwareRendering();				// there is no OpenGL context, the frames are drawn on the CPU (--headless --software)
+unsigned char* softwareFramebuffer();	// the frame drawn on the CPU, bottom-up RGBA rows as glReadPixels returns them
+bool interactive();						// in a window with a terminal on stdin, so an error report may wait for a key
+
 //--------------------------
 struct vec2 {
 //--------------------------
@@ -160,34 +206,1002 @@ inline mat4 RotationMatrix(float angle, vec3 w) {
 			    vec4(0, 0, 0, 1));
 }
 
+//---------------------------
+class GLStateCache { // shadows the bound objects and raster state to skip calls that would not change anything
+//---------------------------
+	static const int maxTextureUnits = 32;
+	static const int numBufferTargets = 4;
+
+	unsigned int program = 0, vertexArray = 0;
+	unsigned int buffers[numBufferTargets] = { 0 };	// buffers bound to the targets that are not part of the vertex array state
+	unsigned int textures[maxTextureUnits] = { 0 };	// GL_TEXTURE_2D binding of each texture unit
+	unsigned int textureBuffers[maxTextureUnits] = { 0 };	// GL_TEXTURE_BUFFER binding of each texture unit
+	unsigned int activeUnit = 0;
+	float currentLineWidth = 1, currentPointSize = 1;
+
+	static int bufferSlot(GLenum target) {
+		switch (target) {
+		case GL_ARRAY_BUFFER: return 0;
+		case GL_PIXEL_UNPACK_BUFFER: return 1;
+		case GL_PIXEL_PACK_BUFFER: return 2;
+		case GL_UNIFORM_BUFFER: return 3;
+		default: return -1;	// e.g. GL_ELEMENT_ARRAY_BUFFER belongs to the vertex array, it is always issued
+		}
+	}
+
+	bool changes(bool changed) {	// count the call as issued or skipped
+		if (changed) issued++; else skipped++;
+		return changed;
+	}
+
+public:
+	unsigned int issued = 0, skipped = 0;	// calls of the current frame
+	unsigned int lastIssued = 0, lastSkipped = 0;	// calls of the previous frame
+
+	void useProgram(unsigned int id) {
+		if (changes(program != id)) { program = id; glUseProgram(id); }
+	}
+
+	void bindVertexArray(unsigned int id) {
+		if (changes(vertexArray != id)) { vertexArray = id; glBindVertexArray(id); }
+	}
+
+	void bindBuffer(GLenum target, unsigned int id) {
+		int slot = bufferSlot(target);
+		if (slot < 0) { issued++; glBindBuffer(target, id); return; }
+		if (changes(buffers[slot] != id)) { buffers[slot] = id; glBindBuffer(target, id); }
+	}
+
+	void activeTexture(unsigned int unit) {
+		if (changes(activeUnit != unit)) { activeUnit = unit; glActiveTexture(GL_TEXTURE0 + unit); }
+	}
+
+	void bindTexture(unsigned int id) {	// GL_TEXTURE_2D on the active unit
+		if (activeUnit >= maxTextureUnits) { issued++; glBindTexture(GL_TEXTURE_2D, id); return; }
+		if (changes(textures[activeUnit] != id)) { textures[activeUnit] = id; glBindTexture(GL_TEXTURE_2D, id); }
+	}
+
+	void bindTexture(unsigned int unit, unsigned int id) {
+		activeTexture(unit);
+		bindTexture(id);
+	}
+
+	void bindTextureBuffer(unsigned int unit, unsigned int id) {	// GL_TEXTURE_BUFFER
+		activeTexture(unit);
+		if (unit >= maxTextureUnits) { issued++; glBindTexture(GL_TEXTURE_BUFFER, id); return; }
+		if (changes(textureBuffers[unit] != id)) { textureBuffers[unit] = id; glBindTexture(GL_TEXTURE_BUFFER, id); }
+	}
+
+	void lineWidth(float width) {
+		if (changes(currentLineWidth != width)) { currentLineWidth = width; glLineWidth(width); }
+	}
+
+	void pointSize(float size) {
+		if (changes(currentPointSize != size)) { currentPointSize = size; glPointSize(size); }
+	}
+
+	// a deleted program stays in use until another one is, so the current one is unbound first. Otherwise it would
+	// live on and a new program that gets its name would not be bound by useProgram.
+	void deleteProgram(unsigned int id) {
+		if (program == id) useProgram(0);
+		glDeleteProgram(id);
+	}
+
+	// deleted objects are unbound by OpenGL, so the shadow copy must forget them too
+	void forgetVertexArray(unsigned int id) { if (vertexArray == id) vertexArray = 0; }
+	void forgetBuffer(unsigned int id) {
+		for (int i = 0; i < numBufferTargets; i++) if (buffers[i] == id) buffers[i] = 0;
+	}
+	void forgetTexture(unsigned int id) {
+		for (int i = 0; i < maxTextureUnits; i++) {
+			if (textures[i] == id) textures[i] = 0;
+			if (textureBuffers[i] == id) textureBuffers[i] = 0;
+		}
+	}
+
+	void endFrame() {	// call after the frame is drawn
+		lastIssued = issued; lastSkipped = skipped;
+		issued = skipped = 0;
+	}
+};
+
+inline GLStateCache& glState() { // the state cache of the OpenGL context
+	static GLStateCache cache;
+	return cache;
+}
+
+//---------------------------
+template<typename T>
+class SpscRing { // lock-free queue between exactly one producer thread and one consumer thread
+//---------------------------
+	std::vector<T> items;
+	size_t mask;							// capacity - 1, the capacity is a power of 2
+	alignas(64) std::atomic<size_t> head{ 0 };	// next item to write, advanced by the producer
+	alignas(64) std::atomic<size_t> tail{ 0 };	// next item to read, advanced by the consumer
+
+public:
+	SpscRing(size_t capacity) {
+		size_t size = 1;
+		while (size < capacity) size *= 2;
+		items.resize(size);
+		mask = size - 1;
+	}
+
+	bool push(const T& item) {	// false if the queue is full
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) > mask) return false;
+		items[h & mask] = item;
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& item) {		// false if the queue is empty
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire)) return false;
+		item = items[t & mask];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	size_t size() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+};
+
+//---------------------------
+class WorkStealingPool { // runs tasks, and the tasks they submit, on every core
+//---------------------------
+	// Every worker pops the tasks of its own deque from the back, so a task it submits runs next while its data
+	// is still in the cache. A worker whose deque is empty steals the oldest task, usually the largest piece of work,
+	// from the front of the deque of another worker. The deques are short lists of coarse tasks, a lock each is enough.
+	struct Worker {
+		std::mutex lock;
+		std::deque<std::function<void(int)>> tasks;
+	};
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<long long> pending{ 0 };	// submitted and not finished yet
+	std::atomic<int> nextWorker{ 0 };		// of the tasks submitted from outside
+
+	bool take(int worker, std::function<void(int)>& task) {
+		{
+			Worker& own = *workers[worker];
+			std::lock_guard<std::mutex> guard(own.lock);
+			if (!own.tasks.empty()) {
+				task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+		for (size_t i = 1; i < workers.size(); i++) {
+			Worker& victim = *workers[(worker + i) % workers.size()];
+			std::lock_guard<std::mutex> guard(victim.lock);
+			if (victim.tasks.empty()) continue;
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			stolen++;
+			return true;
+		}
+		return false;
+	}
+
+	void work(int worker) {
+		std::function<void(int)> task;
+		while (pending.load() > 0) {
+			if (!take(worker, task)) { std::this_thread::yield(); continue; }
+			task(worker);
+			pending--;
+		}
+	}
+
+public:
+	std::atomic<long long> stolen{ 0 };	// tasks that ran on another worker than the one they were submitted to
+
+	WorkStealingPool(int numWorkers = 0) {	// 0: one per core
+		if (numWorkers <= 0) numWorkers = std::max(1, (int)std::thread::hardware_concurrency());
+		for (int i = 0; i < numWorkers; i++) workers.push_back(std::unique_ptr<Worker>(new Worker()));
+	}
+
+	int size() const { return (int)workers.size(); }
+
+	// a task gets the index of the worker running it, which it passes on when it submits more tasks
+	void submit(std::function<void(int)> task, int worker = -1) {
+		if (worker < 0) worker = nextWorker++ % (int)workers.size();
+		pending++;
+		std::lock_guard<std::mutex> guard(workers[worker]->lock);
+		workers[worker]->tasks.push_back(std::move(task));
+	}
+
+	void run() {	// returns when every task is done, the calling thread is worker 0
+		std::vector<std::thread> threads;
+		for (int i = 1; i < size(); i++) threads.push_back(std::thread(&WorkStealingPool::work, this, i));
+		work(0);
+		for (auto& thread : threads) thread.join();
+	}
+};
+
+//---------------------------
+class WorkerThreads { // threads kept between parallel loops, so a loop of every frame starts no thread and allocates nothing
+//---------------------------
+	// The calling thread runs the work too and returns when every thread that joined it has finished. The work shares
+	// its items through an atomic counter, so a thread that wakes up after the others took every item simply returns.
+	std::vector<std::thread> threads;
+	std::mutex lock;
+	std::condition_variable wake, done;
+	void (*call)(const void* work) = nullptr;
+	const void* work = nullptr;
+	unsigned int generation = 0;	// of the loop being run, a thread joins each loop once
+	int wanted = 0;					// threads that may still join the loop
+	int running = 0;				// threads in the work of the loop
+	bool stopping = false;
+
+	template<typename Work>
+	static void callWork(const void* work) { (*(const Work*)work)(); }
+
+	void loop() {
+		unsigned int joined = 0;
+		std::unique_lock<std::mutex> guard(lock);
+		for (;;) {
+			wake.wait(guard, [&]() { return stopping || generation != joined; });
+			if (stopping) return;
+			joined = generation;
+			if (wanted == 0) continue;
+			wanted--; running++;
+			guard.unlock();
+			call(work);
+			guard.lock();
+			if (--running == 0) done.notify_all();
+		}
+	}
+
+public:
+	WorkerThreads() = default;
+	WorkerThreads(const WorkerThreads&) = delete;
+	WorkerThreads& operator=(const WorkerThreads&) = delete;
+
+	// run work on numThreads threads at most, the calling thread included; one caller at a time
+	template<typename Work>
+	void run(int numThreads, const Work& _work) {
+		if (numThreads <= 1) { _work(); return; }
+		while ((int)threads.size() < numThreads - 1) threads.push_back(std::thread(&WorkerThreads::loop, this));	// only the first loops of this width
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			call = &callWork<Work>; work = &_work;
+			wanted = numThreads - 1;
+			generation++;
+		}
+		wake.notify_all();
+		_work();
+		std::unique_lock<std::mutex> guard(lock);
+		wanted = 0;		// the items are gone, the threads still asleep are not needed
+		done.wait(guard, [&]() { return running == 0; });
+	}
+
+	~WorkerThreads() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& thread : threads) thread.join();
+	}
+};
+
+inline WorkerThreads& workerThreads() { // the threads of the parallel loops of the render thread
+	static WorkerThreads instance;
+	return instance;
+}
+
+//---------------------------
+class Profiler { // CPU and GPU time of named phases and named counters of every frame, one branch per scope when disabled
+//---------------------------
+public:
+	static const int maxPhases = 16, maxCounters = 12;
+	static const int numBuckets = 20;	// histogram bucket b counts times in [2^b, 2^(b+1)) microseconds
+
+	struct Frame {
+		unsigned int index = 0;
+		int numPhases = 0, numCounters = 0;	// named so far
+		float cpu[maxPhases];			// msec
+		float gpu[maxPhases];			// msec, negative if not measured
+		long long counters[maxCounters];
+	};
+
+private:
+	static const int historySize = 256;	// frames in the ring
+	static const int gpuLatency = 4;	// frames between issuing a timer query and reading its result
+
+	const char* phaseNames[maxPhases];
+	const char* counterNames[maxCounters];
+	int numPhases = 0, numCounters = 0;
+
+	Frame pending[gpuLatency];			// frames whose GPU times may not be available yet
+	unsigned int queries[gpuLatency][maxPhases] = { { 0 } };
+	bool queryIssued[gpuLatency][maxPhases] = { { false } };
+	bool gpuScopeOpen = false;			// GL_TIME_ELAPSED queries cannot be nested
+	unsigned int frameIndex = 0;
+
+	// single producer (the render loop) single consumer (e.g. the csv writer) ring of finished frames
+	Frame ring[historySize];
+	std::atomic<unsigned int> head{ 0 }, tail{ 0 };
+
+	std::thread csvWriter;
+	std::atomic<bool> csvRunning{ false };
+
+	static int find(const char* name, const char** names, int& count, int max) {
+		for (int i = 0; i < count; i++) if (names[i] == name) return i;	// names are usually literals
+		for (int i = 0; i < count; i++) if (strcmp(names[i], name) == 0) return i;
+		if (count == max) return -1;
+		names[count] = name;
+		return count++;
+	}
+
+	static int bucket(float msec) {
+		int b = 0;
+		for (float us = msec * 1000; us >= 2 && b < numBuckets - 1; us /= 2) b++;
+		return b;
+	}
+
+	void clear(Frame& frame, unsigned int index) {
+		frame.index = index;
+		for (int i = 0; i < maxPhases; i++) { frame.cpu[i] = 0; frame.gpu[i] = -1; }
+		for (int i = 0; i < maxCounters; i++) frame.counters[i] = 0;
+	}
+
+	// collect the GPU times that are ready without waiting and publish the frame
+	void finish(int slot) {
+		Frame& frame = pending[slot];
+		for (int i = 0; i < numPhases; i++) {
+			if (!queryIssued[slot][i]) continue;
+			queryIssued[slot][i] = false;
+			int available = 0;
+			glGetQueryObjectiv(queries[slot][i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) continue;
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(queries[slot][i], GL_QUERY_RESULT, &nanoseconds);
+			frame.gpu[i] = nanoseconds / 1e6f;
+		}
+		for (int i = 0; i < numPhases; i++) {
+			if (frame.cpu[i] > 0) cpuHistogram[i][bucket(frame.cpu[i])]++;
+			if (frame.gpu[i] >= 0) gpuHistogram[i][bucket(frame.gpu[i])]++;
+		}
+		frame.numPhases = numPhases;
+		frame.numCounters = numCounters;
+		last = frame;
+		unsigned int h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) == historySize) { dropped++; return; }	// nobody reads, keep the older frames
+		ring[h % historySize] = frame;
+		head.store(h + 1, std::memory_order_release);
+	}
+
+public:
+	bool enabled = false;
+	bool gpuTimers = true;			// false without an OpenGL context
+	Frame last;						// the latest finished frame
+	unsigned int cpuHistogram[maxPhases][numBuckets] = { { 0 } }, gpuHistogram[maxPhases][numBuckets] = { { 0 } };
+	unsigned int dropped = 0;		// frames lost because the ring was full
+
+	Profiler() {
+		for (int i = 0; i < gpuLatency; i++) clear(pending[i], i);
+		clear(last, 0);
+	}
+	~Profiler() { stopCSV(); }
+
+	int getNumPhases() const { return numPhases; }
+	const char* getPhaseName(int phase) const { return phaseNames[phase]; }
+
+	int phase(const char* name) { return find(name, phaseNames, numPhases, maxPhases); }
+
+	void addTime(int phase, float msec) { if (phase >= 0) pending[frameIndex % gpuLatency].cpu[phase] += msec; }
+
+	void count(const char* name, long long amount) {	// add to a counter of the current frame
+		if (!enabled) return;
+		int counter = find(name, counterNames, numCounters, maxCounters);
+		if (counter >= 0) pending[frameIndex % gpuLatency].counters[counter] += amount;
+	}
+
+	bool beginGpu(int phase) {	// start the timer query of the phase unless another one is running
+		if (!gpuTimers || phase < 0 || gpuScopeOpen) return false;
+		int slot = frameIndex % gpuLatency;
+		if (queries[slot][phase] == 0) glGenQueries(1, &queries[slot][phase]);
+		if (queryIssued[slot][phase]) return false;	// measured once per frame
+		glBeginQuery(GL_TIME_ELAPSED, queries[slot][phase]);
+		queryIssued[slot][phase] = gpuScopeOpen = true;
+		return true;
+	}
+
+	void endGpu() {
+		glEndQuery(GL_TIME_ELAPSED);
+		gpuScopeOpen = false;
+	}
+
+	void endFrame() {	// call after the frame is drawn
+		if (!enabled) return;
+		frameIndex++;
+		int slot = frameIndex % gpuLatency;	// the frame issued gpuLatency frames ago
+		finish(slot);
+		clear(pending[slot], frameIndex);
+	}
+
+	bool pop(Frame& frame) {	// the oldest frame not read yet, for the consumer
+		unsigned int t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire)) return false;
+		frame = ring[t % historySize];
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	// stream the frames into a csv file from a background thread, one row per phase and counter of every frame
+	bool startCSV(const char* pathname) {
+		stopCSV();
+		FILE* file = fopen(pathname, "w");
+		if (!file) return false;
+		fprintf(file, "frame,kind,name,cpu ms,gpu ms\n");
+		Frame frame;
+		while (pop(frame)) { }	// start with the frames to come
+		csvRunning = true;
+		csvWriter = std::thread([this, file]() {
+			Frame frame;
+			for (bool running = true; running; ) {
+				running = csvRunning;
+				while (pop(frame)) {	// the names of a frame were registered before it was published
+					for (int i = 0; i < frame.numPhases; i++)
+						fprintf(file, "%u,phase,%s,%.4f,%.4f\n", frame.index, phaseNames[i], frame.cpu[i], frame.gpu[i]);
+					for (int i = 0; i < frame.numCounters; i++)
+						fprintf(file, "%u,counter,%s,%lld,\n", frame.index, counterNames[i], frame.counters[i]);
+				}
+				if (running) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			}
+			fclose(file);
+		});
+		return true;
+	}
+
+	bool isWritingCSV() const { return csvWriter.joinable(); }
+
+	void stopCSV() {
+		if (!csvWriter.joinable()) return;
+		csvRunning = false;
+		csvWriter.join();
+	}
+
+	void printReport() {	// mean times and histograms of every phase
+		printf("Profile of %u frames, %u dropped from the ring\n", frameIndex, dropped);
+		for (int i = 0; i < numPhases; i++) {
+			for (int gpu = 0; gpu < 2; gpu++) {
+				unsigned int* histogram = gpu ? gpuHistogram[i] : cpuHistogram[i];
+				unsigned int total = 0;
+				for (int b = 0; b < numBuckets; b++) total += histogram[b];
+				if (total == 0) continue;
+				printf("  %-12s %s %6u frames, usec:", phaseNames[i], gpu ? "gpu" : "cpu", total);
+				for (int b = 0; b < numBuckets; b++) if (histogram[b]) printf(" <%d:%u", 2 << b, histogram[b]);
+				printf("\n");
+			}
+		}
+		for (int i = 0; i < numCounters; i++) printf("  %-12s %lld in the last frame\n", counterNames[i], last.counters[i]);
+	}
+};
+
+inline Profiler& profiler() { // the profiler of the application
+	static Profiler instance;
+	return instance;
+}
+
+//---------------------------
+class ProfileScope { // adds the time until the end of the scope to a phase of the profiler
+//---------------------------
+	int phase = -1;
+	bool gpu = false;
+	std::chrono::steady_clock::time_point start;
+
+public:
+	// with measureGpu the GPU time of the commands issued in the scope is measured too
+	ProfileScope(const char* name, bool measureGpu = false) {
+		if (!profiler().enabled) return;
+		phase = profiler().phase(name);
+		if (measureGpu) gpu = profiler().beginGpu(phase);
+		start = std::chrono::steady_clock::now();
+	}
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+	~ProfileScope() {
+		if (phase < 0) return;
+		profiler().addTime(phase, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count());
+		if (gpu) profiler().endGpu();
+	}
+};
+
+//---------------------------
+struct HeapStats { // totals of the global operator new and delete while they are counted, by framework.cpp
+//---------------------------
+	long long allocations = 0;	// calls of operator new
+	long long bytes = 0;		// allocated by them
+	long long inUse = 0;		// bytes allocated minus bytes deleted, blocks of before the counting make it smaller
+	long long peak = 0;			// highest inUse since the last resetHeapPeak
+};
+
+HeapStats heapStats();
+void countHeap(bool enabled);	// the heap is counted only while enabled, otherwise operator new costs nothing extra
+void resetHeapPeak();	// the peak starts again from the bytes in use now
+
+//---------------------------
+class AllocationTracker { // allocations, bytes and peak heap of every frame, a steady frame should allocate nothing
+//---------------------------
+	HeapStats last;		// at the end of the previous frame
+
+public:
+	bool enabled = false;
+	long long frames = 0, allocatingFrames = 0, lastAllocatingFrame = -1;
+	long long maxAllocations = 0, maxBytes = 0, maxGrowth = 0;	// of a single frame
+
+	void start() {
+		frames = allocatingFrames = maxAllocations = maxBytes = maxGrowth = 0;
+		lastAllocatingFrame = -1;
+		countHeap(true);
+		last = heapStats();
+		resetHeapPeak();
+		enabled = true;
+	}
+
+	void stop() {
+		enabled = false;
+		countHeap(false);
+	}
+
+	void endFrame() {	// call before profiler().endFrame(), the counts go into the profiled frame
+		if (!enabled) return;
+		HeapStats now = heapStats();
+		long long allocations = now.allocations - last.allocations, bytes = now.bytes - last.bytes, growth = now.peak - last.inUse;
+		profiler().count("allocations", allocations);
+		profiler().count("bytes allocated", bytes);
+		profiler().count("peak heap growth", growth);
+		if (allocations > 0) { allocatingFrames++; lastAllocatingFrame = frames; }
+		maxAllocations = std::max(maxAllocations, allocations);
+		maxBytes = std::max(maxBytes, bytes);
+		maxGrowth = std::max(maxGrowth, growth);
+		frames++;
+		last = heapStats();	// the profiler may have allocated
+		resetHeapPeak();
+	}
+
+	void printReport() {
+		printf("Allocations of %lld frames: %lld frames allocated, the last one was frame %lld\n", frames, allocatingFrames, lastAllocatingFrame);
+		printf("  at most %lld allocations and %lld bytes in a frame, the heap grew by at most %lld bytes during a frame\n", maxAllocations, maxBytes, maxGrowth);
+	}
+};
+
+inline AllocationTracker& allocationTracker() { // the allocation tracker of the application
+	static AllocationTracker instance;
+	return instance;
+}
+
+//---------------------------
+class FrameArena { // bump allocator for the scratch data of a frame, everything is released at once by reset
+//---------------------------
+	struct Chunk { char* memory; size_t size; };
+	static const size_t minChunkSize = 1 << 16;
+
+	std::vector<Chunk> chunks;	// the last one is being filled
+	size_t used = 0;			// bytes of the last chunk
+
+	void grow(size_t bytes) {
+		size_t size = std::max(bytes, chunks.empty() ? minChunkSize : chunks.back().size * 2);
+		char* memory = (char*)::operator new(size);	// counted by the heap statistics like any allocation
+		chunks.push_back({ memory, size });
+		used = 0;
+	}
+
+	void release() {
+		for (Chunk& chunk : chunks) ::operator delete(chunk.memory);
+		chunks.clear();
+	}
+
+public:
+	FrameArena() = default;
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+	~FrameArena() { release(); }
+
+	void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+		if (!chunks.empty()) {
+			uintptr_t base = (uintptr_t)chunks.back().memory;
+			size_t offset = (size_t)(((base + used + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base);
+			if (offset + bytes <= chunks.back().size) {
+				used = offset + bytes;
+				return chunks.back().memory + offset;
+			}
+		}
+		grow(bytes + alignment);
+		return allocate(bytes, alignment);
+	}
+
+	// forget everything allocated, a frame that needed more than one chunk gets one chunk large enough for all of them
+	void reset() {
+		if (chunks.size() > 1) {
+			size_t total = 0;
+			for (const Chunk& chunk : chunks) total += chunk.size;
+			release();
+			grow(total);
+		}
+		used = 0;
+	}
+
+	size_t capacity() const {
+		size_t total = 0;
+		for (const Chunk& chunk : chunks) total += chunk.size;
+		return total;
+	}
+};
+
+// Scratch memory of the calling thread. The render thread resets it at the end of every frame, other threads that
+// use it reset it after each of their tasks.
+inline FrameArena& frameArena() {
+	static thread_local FrameArena arena;
+	return arena;
+}
+
+template<typename T>
+struct FrameAllocator { // standard allocator on the frame arena of the thread, deallocation is a no-op
+	typedef T value_type;
+	FrameAllocator() = default;
+	template<typename U> FrameAllocator(const FrameAllocator<U>&) { }
+	T* allocate(size_t n) { return (T*)frameArena().allocate(n * sizeof(T), alignof(T)); }
+	void deallocate(T*, size_t) { }
+	template<typename U> bool operator==(const FrameAllocator<U>&) const { return true; }
+	template<typename U> bool operator!=(const FrameAllocator<U>&) const { return false; }
+};
+
+template<typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;	// must not outlive the frame
+
+//---------------------------
+class GLResourcePool { // recycles buffer and texture names together with their storage
+//---------------------------
+	struct FreeBuffer { unsigned int id; size_t capacity; };
+	struct FreeTexture { unsigned int id; int width, height; GLenum internalFormat; };
+
+	static const size_t maxFree = 64;	// beyond this released objects are deleted
+	std::vector<FreeBuffer> freeBuffers;
+	std::vector<FreeTexture> freeTextures;
+
+public:
+	unsigned int buffersCreated = 0, buffersReused = 0, texturesCreated = 0, texturesReused = 0;
+
+	// a free buffer whose storage holds at least minCapacity bytes if there is one, otherwise any free or a new name
+	unsigned int acquireBuffer(size_t minCapacity, size_t& capacity) {
+		int best = -1;
+		for (int i = 0; i < (int)freeBuffers.size(); i++) {
+			if (freeBuffers[i].capacity < minCapacity) continue;
+			if (best < 0 || freeBuffers[i].capacity < freeBuffers[best].capacity) best = i;
+		}
+		if (best < 0 && !freeBuffers.empty()) best = 0;
+		if (best >= 0) {
+			FreeBuffer buffer = freeBuffers[best];
+			freeBuffers[best] = freeBuffers.back();
+			freeBuffers.pop_back();
+			capacity = buffer.capacity;
+			buffersReused++;
+			return buffer.id;
+		}
+		unsigned int id = 0;
+		glGenBuffers(1, &id);
+		capacity = 0;
+		buffersCreated++;
+		return id;
+	}
+
+	void releaseBuffer(unsigned int id, size_t capacity) {
+		if (id == 0) return;
+		if (freeBuffers.size() < maxFree) { freeBuffers.push_back({ id, capacity }); return; }
+		glState().forgetBuffer(id);
+		glDeleteBuffers(1, &id);
+	}
+
+	// hasStorage tells if the texture already has an image of this size and format, so glTexSubImage2D can fill it
+	unsigned int acquireTexture(int width, int height, GLenum internalFormat, bool& hasStorage) {
+		int any = -1;
+		for (int i = 0; i < (int)freeTextures.size(); i++) {
+			const FreeTexture& texture = freeTextures[i];
+			if (texture.width == width && texture.height == height && texture.internalFormat == internalFormat) { any = i; break; }
+			if (any < 0) any = i;
+		}
+		if (any >= 0) {
+			FreeTexture texture = freeTextures[any];
+			freeTextures[any] = freeTextures.back();
+			freeTextures.pop_back();
+			hasStorage = texture.width == width && texture.height == height && texture.internalFormat == internalFormat;
+			texturesReused++;
+			return texture.id;
+		}
+		unsigned int id = 0;
+		glGenTextures(1, &id);
+		hasStorage = false;
+		texturesCreated++;
+		return id;
+	}
+
+	void releaseTexture(unsigned int id, int width, int height, GLenum internalFormat) {
+		if (id == 0) return;
+		if (freeTextures.size() < maxFree) { freeTextures.push_back({ id, width, height, internalFormat }); return; }
+		glState().forgetTexture(id);
+		glDeleteTextures(1, &id);
+	}
+
+	void trim() {	// delete every object that waits for reuse
+		for (auto& buffer : freeBuffers) { glState().forgetBuffer(buffer.id); glDeleteBuffers(1, &buffer.id); }
+		for (auto& texture : freeTextures) { glState().forgetTexture(texture.id); glDeleteTextures(1, &texture.id); }
+		freeBuffers.clear();
+		freeTextures.clear();
+	}
+};
+
+inline GLResourcePool& glPool() { // the resource pool of the OpenGL context
+	static GLResourcePool* pool = new GLResourcePool();	// never destroyed: global handles release into it at exit
+	return *pool;
+}
+
+//---------------------------
+class GLBuffer { // buffer object owned by exactly one handle, returned to the pool when the handle dies
+//---------------------------
+	unsigned int id = 0;
+	size_t capacity = 0;	// bytes of storage allocated on the GPU
+
+public:
+	GLBuffer() { }
+	GLBuffer(const GLBuffer&) = delete;
+	GLBuffer& operator=(const GLBuffer&) = delete;
+	GLBuffer(GLBuffer&& other) noexcept : id(other.id), capacity(other.capacity) { other.id = 0; other.capacity = 0; }
+	GLBuffer& operator=(GLBuffer&& other) noexcept {
+		if (this != &other) {
+			glPool().releaseBuffer(id, capacity);
+			id = other.id; capacity = other.capacity;
+			other.id = 0; other.capacity = 0;
+		}
+		return *this;
+	}
+	~GLBuffer() { glPool().releaseBuffer(id, capacity); }
+
+	void create(size_t minCapacity = 0) { if (id == 0) id = glPool().acquireBuffer(minCapacity, capacity); }
+	unsigned int getId() const { return id; }
+	size_t getCapacity() const { return capacity; }
+
+	void bind(GLenum target = GL_ARRAY_BUFFER) { glState().bindBuffer(target, id); }
+
+	// copy data to the GPU, the storage is reallocated only when it is too small, with room to grow
+	void upload(const void* data, size_t bytes, GLenum target = GL_ARRAY_BUFFER, GLenum usage = GL_DYNAMIC_DRAW) {
+		create(bytes);
+		bind(target);
+		if (bytes > capacity) {
+			capacity = bytes + bytes / 2;
+			glBufferData(target, capacity, nullptr, usage);
+		}
+		if (bytes > 0) glBufferSubData(target, 0, bytes, data);
+		profiler().count("bytes uploaded", bytes);
+	}
+};
+
+//---------------------------
+class GLVertexArray { // vertex array object owned by exactly one handle
+//---------------------------
+	unsigned int id = 0;
+
+public:
+	GLVertexArray() { }
+	GLVertexArray(const GLVertexArray&) = delete;
+	GLVertexArray& operator=(const GLVertexArray&) = delete;
+	GLVertexArray(GLVertexArray&& other) noexcept : id(other.id) { other.id = 0; }
+	GLVertexArray& operator=(GLVertexArray&& other) noexcept {
+		if (this != &other) { destroy(); id = other.id; other.id = 0; }
+		return *this;
+	}
+	~GLVertexArray() { destroy(); }
+
+	void create() { if (id == 0) glGenVertexArrays(1, &id); }
+	void destroy() {
+		if (id == 0) return;
+		glState().forgetVertexArray(id);
+		glDeleteVertexArrays(1, &id);
+		id = 0;
+	}
+	unsigned int getId() const { return id; }
+	void bind() { glState().bindVertexArray(id); }
+};
+
+//---------------------------
+class MappedFile { // read-only memory mapping of a whole file
+//---------------------------
+	const unsigned char* bytes = nullptr;
+	size_t length = 0;
+#if defined(_WIN32)
+	HANDLE file = INVALID_HANDLE_VALUE, mapping = NULL;
+#endif
+
+public:
+	MappedFile(const std::string& pathname) {
+#if defined(_WIN32)
+		file = CreateFileA(pathname.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE) return;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) return;
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) return;
+		bytes = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if (bytes) length = (size_t)fileSize.QuadPart;
+#else
+		int fd = open(pathname.c_str(), O_RDONLY);
+		if (fd < 0) return;
+		struct stat info;
+		if (fstat(fd, &info) == 0 && info.st_size > 0) {
+			void* p = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED) {
+				bytes = (const unsigned char*)p;
+				length = (size_t)info.st_size;
+				madvise(p, length, MADV_SEQUENTIAL);
+			}
+		}
+		close(fd);	// the mapping stays valid
+#endif
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool isOpen() const { return bytes != nullptr; }
+	const unsigned char* data() const { return bytes; }
+	size_t size() const { return length; }
+
+	void prefetch(size_t offset, size_t bytes) const {	// ask the system to read a range in ahead of its use
+#if !defined(_WIN32)
+		if (!isOpen() || offset >= length) return;
+		size_t page = (size_t)sysconf(_SC_PAGESIZE), first = offset / page * page;
+		madvise((void*)(data() + first), std::min(offset + bytes, length) - first, MADV_WILLNEED);
+#endif
+	}
+
+	~MappedFile() {
+#if defined(_WIN32)
+		if (bytes) UnmapViewOfFile(bytes);
+		if (mapping != NULL) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+		if (bytes) munmap((void*)bytes, length);
+#endif
+	}
+};
+
+// the names of the regular files in the directory, sorted
+inline std::vector<std::string> listDirectory(const std::string& directory) {
+	std::vector<std::string> names;
+#if defined(_WIN32)
+	WIN32_FIND_DATAA entry;
+	HANDLE find = FindFirstFileA((directory + "\\*").c_str(), &entry);
+	if (find == INVALID_HANDLE_VALUE) return names;
+	do {
+		if (!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) names.push_back(entry.cFileName);
+	} while (FindNextFileA(find, &entry));
+	FindClose(find);
+#else
+	DIR* dir = opendir(directory.c_str());
+	if (!dir) return names;
+	while (struct dirent* entry = readdir(dir)) {
+		struct stat info;
+		if (stat((directory + "/" + entry->d_name).c_str(), &info) == 0 && S_ISREG(info.st_mode)) names.push_back(entry->d_name);
+	}
+	closedir(dir);
+#endif
+	std::sort(names.begin(), names.end());
+	return names;
+}
+
+//---------------------------
+struct BitmapInfo { // fields of an uncompressed 24 or 32 bit BMP file that are needed to decode its pixels
+//---------------------------
+	int width = 0, height = 0;
+	int bitsPerPixel = 0;
+	size_t pixelOffset = 0;		// start of the pixel rows in the file
+	size_t rowPitch = 0;		// bytes per row including the padding to 4 bytes
+	bool topDown = false;		// negative height in the header: the first row is the top row
+
+	static unsigned int read16(const unsigned char* p) { return p[0] | (p[1] << 8); }
+	static unsigned int read32(const unsigned char* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24); }
+
+	bool parse(const unsigned char* file, size_t fileSize) {
+		if (fileSize < 54 || read16(file) != 0x4D42) { printf("Not bmp file\n"); return false; }
+		pixelOffset = read32(file + 10);			// bfOffBits
+		width = (int)read32(file + 18);				// biWidth
+		height = (int)read32(file + 22);			// biHeight
+		bitsPerPixel = (int)read16(file + 28);		// biBitCount
+		unsigned int compression = read32(file + 30);	// biCompression
+		if ((bitsPerPixel != 24 && bitsPerPixel != 32) || (compression != 0 && compression != 3)) {
+			printf("Only uncompressed true color bmp files are supported\n");
+			return false;
+		}
+		if (compression == 3) {	// BI_BITFIELDS: the red, green and blue masks follow the 40 byte info header
+			if (bitsPerPixel != 32 || fileSize < 66 || read32(file + 54) != 0x00FF0000 || read32(file + 58) != 0x0000FF00 || read32(file + 62) != 0x000000FF) {
+				printf("Only bmp files with BGRA channel masks are supported\n");
+				return false;
+			}
+		}
+		topDown = height < 0;
+		if (topDown) height = -height;
+		rowPitch = ((size_t)width * (bitsPerPixel / 8) + 3) & ~(size_t)3;
+		if (width <= 0 || pixelOffset + rowPitch * height > fileSize) { printf("Truncated bmp file\n"); return false; }
+		return true;
+	}
+};
+
 //---------------------------
 class Texture {
 //---------------------------
-	std::vector<vec4> load(std::string pathname, bool transparent, int& width, int& height) {
-		FILE * file = fopen(pathname.c_str(), "r");
-		if (!file) {
-			printf("%s does not exist\n", pathname.c_str());
-			width = height = 0;
-			return std::vector<vec4>();
-		}
-		unsigned short bitmapFileHeader[27];					// bitmap header
-		fread(&bitmapFileHeader, 27, 2, file);
-		if (bitmapFileHeader[0] != 0x4D42) printf("Not bmp file\n");
-		if (bitmapFileHeader[14] != 24) printf("Only true color bmp files are supported\n");
-		width = bitmapFileHeader[9];
-		height = bitmapFileHeader[11];
-		unsigned int size = (unsigned long)bitmapFileHeader[17] + (unsigned long)bitmapFileHeader[18] * 65536;
-		fseek(file, 54, SEEK_SET);
-		std::vector<unsigned char> bImage(size);
-		fread(&bImage[0], 1, size, file); 	// read the pixels
-		fclose(file);
-		std::vector<vec4> image(width * height);
-		int i = 0;
-		for (unsigned int idx = 0; idx < size; idx += 3) { // Swap R and B since in BMP, the order is BGR
-			float alpha = (transparent) ? (bImage[idx] + bImage[idx + 1] + bImage[idx + 2]) / 3.0f / 256.0f : 1.0f;
-			image[i++] = vec4(bImage[idx + 2] / 256.0f, bImage[idx + 1] / 256.0f, bImage[idx] / 256.0f, alpha);
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	static bool hasSSSE3() {	// the default builds target SSE2 only, so the shuffle is chosen by the CPU at run time
+		static const bool supported = [] {
+#if defined(_MSC_VER)
+			int cpuInfo[4];
+			__cpuid(cpuInfo, 1);
+			return (cpuInfo[2] & (1 << 9)) != 0;
+#else
+			return __builtin_cpu_supports("ssse3") != 0;
+#endif
+		}();
+		return supported;
+	}
+
+	// opaque BGR to RGBA, 4 pixels per shuffle, stops while 16 bytes can be read inside the row; returns the pixels done
+#if defined(__GNUC__)
+	__attribute__((target("ssse3")))
+#endif
+	static int swizzleRowSSSE3(const unsigned char* src, unsigned char* dst, int width) {
+		const __m128i swizzle = _mm_setr_epi8(2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128);
+		const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
+		int x = 0;
+		for (; x + 6 <= width; x += 4) {
+			__m128i bgr = _mm_loadu_si128((const __m128i*)(src + 3 * x));
+			_mm_storeu_si128((__m128i*)(dst + 4 * x), _mm_or_si128(_mm_shuffle_epi8(bgr, swizzle), opaque));
+		}
+		return x;
+	}
+#endif
+
+	// convert BGR(A) rows [firstRow, lastRow) of the file to RGBA8, texture row 0 is the bottom row as in OpenGL
+	static void convertRows(const BitmapInfo& info, const unsigned char* pixels, bool transparent, unsigned char* rgba, int firstRow, int lastRow) {
+		int bytesPerPixel = info.bitsPerPixel / 8;
+		for (int row = firstRow; row < lastRow; row++) {
+			const unsigned char* src = pixels + info.rowPitch * (info.topDown ? info.height - 1 - row : row);
+			unsigned char* dst = rgba + (size_t)row * info.width * 4;
+			int x = 0;
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+			if (bytesPerPixel == 3 && !transparent && hasSSSE3()) x = swizzleRowSSSE3(src, dst, info.width);
+#endif
+			for (; x < info.width; x++) { // Swap R and B since in BMP, the order is BGR
+				const unsigned char* p = src + x * bytesPerPixel;
+				dst[4 * x + 0] = p[2];
+				dst[4 * x + 1] = p[1];
+				dst[4 * x + 2] = p[0];
+				dst[4 * x + 3] = (transparent) ? (unsigned char)((p[0] + p[1] + p[2]) / 3) : 255;
+			}
 		}
-		return image;
+	}
+
+	// decode the pixels with one thread per block of rows
+	static void convert(const BitmapInfo& info, const unsigned char* pixels, bool transparent, unsigned char* rgba) {
+		int numThreads = (int)std::thread::hardware_concurrency();
+		if ((size_t)info.width * info.height < (1 << 20) || numThreads < 2) numThreads = 1; // not worth the threads for small images
+		if (numThreads > info.height) numThreads = info.height;
+		std::vector<std::thread> threads;
+		for (int i = 1; i < numThreads; i++)
+			threads.push_back(std::thread(convertRows, std::cref(info), pixels, transparent, rgba, info.height * i / numThreads, info.height * (i + 1) / numThreads));
+		convertRows(info, pixels, transparent, rgba, 0, info.height / numThreads);
+		for (auto& thread : threads) thread.join();
+	}
+
+	int width = 0, height = 0;
+	GLenum internalFormat = 0;
+
+	// bind a texture that can hold the image, a pooled texture of the same size is refilled instead of reallocated
+	bool prepare(int _width, int _height, GLenum _internalFormat) {
+		bool hasStorage = textureId > 0 && width == _width && height == _height && internalFormat == _internalFormat;
+		if (textureId == 0) textureId = glPool().acquireTexture(_width, _height, _internalFormat, hasStorage);  	// id generation
+		width = _width; height = _height; internalFormat = _internalFormat;
+		glState().bindTexture(textureId);    // binding
+		return hasStorage;
 	}
 
 public:
@@ -195,9 +1209,9 @@ public:
 
 	Texture() { textureId = 0; }
 
-	Texture(std::string pathname, bool transparent = false) {
+	Texture(std::string pathname, bool transparent = false, bool usePixelBuffer = false) {
 		textureId = 0;
-		create(pathname, transparent);
+		create(pathname, transparent, usePixelBuffer);
 	}
 
 	Texture(int width, int height, const std::vector<vec4>& image, int sampling = GL_LINEAR) {
@@ -205,32 +1219,90 @@ public:
 		create(width, height, image, sampling);
 	}
 
-	Texture(const Texture& texture) {
-		printf("\nError: Texture resource is not copied on GPU!!!\n");
+	Texture(const Texture& texture) = delete;	// the resource is not copied on GPU, move it instead
+	Texture& operator=(const Texture& texture) = delete;
+
+	Texture(Texture&& texture) noexcept { *this = std::move(texture); }
+
+	Texture& operator=(Texture&& texture) noexcept {
+		if (this != &texture) {
+			release();
+			textureId = texture.textureId; width = texture.width; height = texture.height; internalFormat = texture.internalFormat;
+			texture.textureId = 0;
+		}
+		return *this;
 	}
 
-	void operator=(const Texture& texture) {
-		printf("\nError: Texture resource is not copied on GPU!!!\n");
+	void release() {	// give the texture back to the pool
+		glPool().releaseTexture(textureId, width, height, internalFormat);
+		textureId = 0;
 	}
 
-	void create(std::string pathname, bool transparent = false) {
-		int width, height;
-		std::vector<vec4> image = load(pathname, transparent, width, height);
-		if (image.size() > 0) create(width, height, image);
+	// load a BMP file as an RGBA8 texture, with usePixelBuffer the pixels are decoded straight into a mapped pixel buffer object
+	void create(std::string pathname, bool transparent = false, bool usePixelBuffer = false) {
+		MappedFile file(pathname);
+		if (!file.isOpen()) {
+			printf("%s does not exist\n", pathname.c_str());
+			return;
+		}
+		BitmapInfo info;
+		if (!info.parse(file.data(), file.size())) return;
+		size_t size = (size_t)info.width * info.height * 4;
+
+		if (usePixelBuffer) {
+			unsigned int pixelBuffer = 0;
+			glGenBuffers(1, &pixelBuffer);
+			glState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+			unsigned char* rgba = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+			if (rgba) {
+				convert(info, file.data() + info.pixelOffset, transparent, rgba);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+				create(info.width, info.height, nullptr, GL_LINEAR);	// the texture is filled from the bound pixel buffer, the copy can run asynchronously
+			}
+			glState().bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glState().forgetBuffer(pixelBuffer);
+			glDeleteBuffers(1, &pixelBuffer);	// the driver keeps the storage until the upload is done
+			if (rgba) return;
+		}
+		std::vector<unsigned char> rgba(size);
+		convert(info, file.data() + info.pixelOffset, transparent, &rgba[0]);
+		create(info.width, info.height, &rgba[0], GL_LINEAR);
 	}
 
 	void create(int width, int height, const std::vector<vec4>& image, int sampling = GL_LINEAR) {
-		if (textureId == 0) glGenTextures(1, &textureId);  				// id generation
-		glBindTexture(GL_TEXTURE_2D, textureId);    // binding
-
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_FLOAT, &image[0]); // To GPU
+		if (prepare(width, height, GL_RGBA)) glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_FLOAT, &image[0]);
+		else glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_FLOAT, &image[0]); // To GPU
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampling); // sampling
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampling);
 	}
 
-	~Texture() {
-		if (textureId > 0) glDeleteTextures(1, &textureId);
+	// 4 bytes per pixel, or an offset into the bound GL_PIXEL_UNPACK_BUFFER
+	void create(int width, int height, const unsigned char* rgba, int sampling = GL_LINEAR) {
+		if (prepare(width, height, GL_RGBA8)) glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, rgba);
+		else glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba); // To GPU
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, sampling); // sampling
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, sampling);
 	}
+
+	~Texture() { release(); }
+};
+
+inline bool hasGLExtension(const char* name) {	// is the extension supported by the current context
+	int count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (int i = 0; i < count; i++)
+		if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0) return true;
+	return false;
+}
+
+//---------------------------
+struct UniformHandle { // location of a uniform variable resolved once with GPUProgram::getUniform
+//---------------------------
+	int location = -1;
+
+	UniformHandle(int _location = -1) { location = _location; }
+	bool isValid() const { return location >= 0; }
 };
 
 //---------------------------
@@ -239,6 +1311,133 @@ class GPUProgram {
 	unsigned int shaderProgramId = 0;
 	unsigned int vertexShader = 0, geometryShader = 0, fragmentShader = 0;
 	bool waitError = true;
+	std::vector<std::pair<std::string, int>> uniforms; // name and location of the active uniforms, filled after linking
+	std::string binaryPath;			// file of the program binary in the cache, empty if there is no cache
+	bool loadedFromBinary = false;
+
+	static bool parallelCompileSupported() {
+		static int supported = -1;
+		if (supported < 0) supported = hasGLExtension("GL_KHR_parallel_shader_compile") || hasGLExtension("GL_ARB_parallel_shader_compile");
+		return supported != 0;
+	}
+
+	static void enableParallelCompile() {	// let the driver use as many compiler threads as it likes, once per context
+		static bool enabled = false;
+		if (enabled) return;
+		enabled = true;
+#if !defined(__APPLE__)
+		typedef void (APIENTRY *MaxShaderCompilerThreads)(GLuint count);
+		MaxShaderCompilerThreads maxThreads = nullptr;
+		if (hasGLExtension("GL_KHR_parallel_shader_compile")) maxThreads = (MaxShaderCompilerThreads)getProcAddress("glMaxShaderCompilerThreadsKHR");
+		else if (hasGLExtension("GL_ARB_parallel_shader_compile")) maxThreads = (MaxShaderCompilerThreads)getProcAddress("glMaxShaderCompilerThreadsARB");
+		if (maxThreads) maxThreads(0xFFFFFFFF);
+#endif
+	}
+
+	static bool binarySupported() {
+#if defined(__APPLE__)
+		bool entryPoints = true;
+#else
+		bool entryPoints = GLEW_ARB_get_program_binary != 0;
+#endif
+		int formats = 0;
+		if (entryPoints) glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+	}
+
+	// the per-user cache of the platform rather than the working directory: %LOCALAPPDATA%, $XDG_CACHE_HOME or ~/.cache
+	static std::string defaultBinaryCacheDirectory() {
+#if defined(_WIN32)
+		const char* base = getenv("LOCALAPPDATA");
+		if (base == nullptr || *base == '\0') return std::string();
+		return std::string(base) + "\\Skeleton\\shadercache";
+#else
+		const char* xdg = getenv("XDG_CACHE_HOME");
+		if (xdg != nullptr && *xdg == '/') return std::string(xdg) + "/skeleton/shadercache";	// a relative path is invalid by the spec
+		const char* home = getenv("HOME");
+		if (home == nullptr || *home == '\0') return std::string();
+		return std::string(home) + "/.cache/skeleton/shadercache";
+#endif
+	}
+
+	static bool makeDirectories(const std::string& path) {	// create the directory with its missing parents
+		int result = 0;
+		for (size_t i = 1; i <= path.size(); i++) {
+			if (i < path.size() && path[i] != '/' && path[i] != '\\') continue;
+			std::string prefix = path.substr(0, i);
+#if defined(_WIN32)
+			result = _mkdir(prefix.c_str());
+#else
+			result = mkdir(prefix.c_str(), 0755);
+#endif
+		}
+		return result == 0 || errno == EEXIST;	// only the last one counts, the parents may exist or be drive letters
+	}
+
+	// the binary is only valid for the same sources on the same driver, so all of them are hashed into the file name
+	static std::string binaryCachePath(const char* vertexSource, const char* fragmentSource, const char* outputName, const char* geometrySource) {
+		std::string& directory = binaryCacheDirectory();
+		if (directory.empty() || !binarySupported()) return std::string();
+		static std::string created;	// checked once per directory, one that cannot be created turns the cache off
+		if (directory != created) {
+			if (!makeDirectories(directory)) {
+				printf("Shader cache %s cannot be created, programs are compiled from source\n", directory.c_str());
+				directory.clear();
+				return std::string();
+			}
+			created = directory;
+		}
+		unsigned long long hash = 14695981039346656037ULL;	// FNV-1a
+		auto add = [&hash](const char* text) {
+			if (text == nullptr) text = "";
+			for (const char* c = text; *c; c++) { hash ^= (unsigned char)*c; hash *= 1099511628211ULL; }
+			hash ^= 0xFF; hash *= 1099511628211ULL;	// separator
+		};
+		add(vertexSource); add(fragmentSource); add(outputName); add(geometrySource);
+		add((const char*)glGetString(GL_VENDOR)); add((const char*)glGetString(GL_RENDERER)); add((const char*)glGetString(GL_VERSION));
+		char name[32];
+		snprintf(name, sizeof(name), "/%016llx.bin", hash);
+		return directory + name;
+	}
+
+	bool loadBinary() {
+		if (binaryPath.empty()) return false;
+		FILE* file = fopen(binaryPath.c_str(), "rb");
+		if (!file) return false;
+		unsigned int format = 0;
+		std::vector<char> binary;
+		if (fread(&format, sizeof(format), 1, file) == 1) {
+			fseek(file, 0, SEEK_END);
+			long size = ftell(file) - (long)sizeof(format);
+			fseek(file, sizeof(format), SEEK_SET);
+			if (size > 0) {
+				binary.resize(size);
+				if (fread(&binary[0], 1, size, file) != (size_t)size) binary.clear();
+			}
+		}
+		fclose(file);
+		if (binary.empty()) return false;
+		glProgramBinary(shaderProgramId, format, &binary[0], (GLsizei)binary.size());
+		int OK = 0;
+		glGetProgramiv(shaderProgramId, GL_LINK_STATUS, &OK);
+		return OK != 0;	// e.g. after a driver update the binary is rejected and the program is compiled from source
+	}
+
+	void saveBinary() {
+		if (binaryPath.empty()) return;
+		int length = 0;
+		glGetProgramiv(shaderProgramId, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0) return;
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		glGetProgramBinary(shaderProgramId, length, &length, &format, &binary[0]);
+		FILE* file = fopen(binaryPath.c_str(), "wb");
+		if (!file) return;
+		unsigned int format32 = format;
+		fwrite(&format32, sizeof(format32), 1, file);
+		fwrite(&binary[0], 1, length, file);
+		fclose(file);
+	}
 
 	void getErrorInfo(unsigned int handle) { // shader error report
 		int logLen, written;
@@ -247,7 +1446,7 @@ class GPUProgram {
 			std::string log(logLen, '\0');
 			glGetShaderInfoLog(handle, logLen, &written, &log[0]);
 			printf("Shader log:\n%s", log.c_str());
-			if (waitError) getchar();
+			if (waitError && interactive()) getchar();	// headless, batch and replay runs must not hang
 		}
 	}
 
@@ -273,29 +1472,109 @@ class GPUProgram {
 		return true;
 	}
 
-	int getLocation(const std::string& name) {	// get the address of a GPU uniform variable
-		int location = glGetUniformLocation(shaderProgramId, name.c_str());
-		if (location < 0) printf("uniform %s cannot be set\n", name.c_str());
+	void cacheUniforms() {	// enumerate the active uniforms once, so that setting them needs no driver query
+		uniforms.clear();
+		int count = 0, maxLength = 0;
+		glGetProgramiv(shaderProgramId, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(shaderProgramId, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::vector<char> name(maxLength + 1);
+		for (int i = 0; i < count; i++) {
+			int length = 0, size = 0;
+			GLenum type;
+			glGetActiveUniform(shaderProgramId, i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+			std::string uniformName(&name[0], length);
+			if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+				uniformName.resize(uniformName.size() - 3); // arrays are reported as name[0]
+			int location = glGetUniformLocation(shaderProgramId, uniformName.c_str());
+			if (location >= 0) uniforms.push_back(std::make_pair(uniformName, location));
+		}
+	}
+
+	int getLocation(const char * const name) {	// get the address of a GPU uniform variable from the cache
+		for (auto& uniform : uniforms)
+			if (strcmp(uniform.first.c_str(), name) == 0) return uniform.second;
+		// not enumerated, e.g. an array element as "lights[2]" or a struct member: ask the driver once and remember the answer
+		int location = glGetUniformLocation(shaderProgramId, name);
+		if (location < 0) printf("uniform %s cannot be set\n", name);
+		uniforms.push_back(std::make_pair(std::string(name), location));
 		return location;
 	}
 
 public:
+	struct CacheStats { int loaded = 0, compiled = 0; };	// programs created from the binary cache and from source
+
+	static CacheStats& cacheStats() {
+		static CacheStats stats;
+		return stats;
+	}
+
+	static std::string& binaryCacheDirectory() {	// where program binaries are stored, empty disables the cache
+		static std::string directory = defaultBinaryCacheDirectory();
+		return directory;
+	}
+
 	GPUProgram(bool _waitError = true) { shaderProgramId = 0; waitError = _waitError; }
 
-	GPUProgram(const GPUProgram& program) {
-		if (program.shaderProgramId > 0) printf("\nError: GPU program is not copied on GPU!!!\n");
+	GPUProgram(const GPUProgram& program) = delete;	// the program is not copied on GPU, move it instead
+	GPUProgram& operator=(const GPUProgram& program) = delete;
+
+	GPUProgram(GPUProgram&& program) noexcept { *this = std::move(program); }
+
+	GPUProgram& operator=(GPUProgram&& program) noexcept {
+		if (this != &program) {
+			destroy();
+			shaderProgramId = program.shaderProgramId;
+			vertexShader = program.vertexShader; geometryShader = program.geometryShader; fragmentShader = program.fragmentShader;
+			waitError = program.waitError;
+			uniforms = std::move(program.uniforms);
+			binaryPath = std::move(program.binaryPath);
+			loadedFromBinary = program.loadedFromBinary;
+			program.shaderProgramId = program.vertexShader = program.geometryShader = program.fragmentShader = 0;
+		}
+		return *this;
 	}
 
-	void operator=(const GPUProgram& program) {
-		if (program.shaderProgramId > 0) printf("\nError: GPU program is not copied on GPU!!!\n");
+	void destroy() {	// delete the program and its shaders
+		if (shaderProgramId > 0) {
+			glState().deleteProgram(shaderProgramId);
+		}
+		if (vertexShader > 0) glDeleteShader(vertexShader);
+		if (geometryShader > 0) glDeleteShader(geometryShader);
+		if (fragmentShader > 0) glDeleteShader(fragmentShader);
+		shaderProgramId = vertexShader = geometryShader = fragmentShader = 0;
 	}
 
 	unsigned int getId() { return shaderProgramId; }
 
+	// compile and link, or load the program from the binary cache
 	bool create(const char * const vertexShaderSource,
 		        const char * const fragmentShaderSource, const char * const fragmentShaderOutputName,
 		        const char * const geometryShaderSource = nullptr)
 	{
+		if (!createAsync(vertexShaderSource, fragmentShaderSource, fragmentShaderOutputName, geometryShaderSource)) return false;
+		return finish();
+	}
+
+	// start compiling and linking without waiting for the result, call finish() before using the program.
+	// With GL_KHR_parallel_shader_compile the driver compiles several programs queued this way in the background.
+	bool createAsync(const char * const vertexShaderSource,
+		             const char * const fragmentShaderSource, const char * const fragmentShaderOutputName,
+		             const char * const geometryShaderSource = nullptr)
+	{
+		enableParallelCompile();
+		if (shaderProgramId > 0) {	// created again: replace the previous program
+			glState().deleteProgram(shaderProgramId);
+		}
+		shaderProgramId = glCreateProgram();
+		if (!shaderProgramId) {
+			printf("Error in shader program creation\n");
+			exit(1);
+		}
+
+		binaryPath = binaryCachePath(vertexShaderSource, fragmentShaderSource, fragmentShaderOutputName, geometryShaderSource);
+		loadedFromBinary = loadBinary();
+		if (loadedFromBinary) return true;
+
 		// Create vertex shader from string
 		if (vertexShader == 0) vertexShader = glCreateShader(GL_VERTEX_SHADER);
 		if (!vertexShader) {
@@ -304,7 +1583,6 @@ public:
 		}
 		glShaderSource(vertexShader, 1, (const GLchar**)&vertexShaderSource, NULL);
 		glCompileShader(vertexShader);
-		if (!checkShader(vertexShader, "Vertex shader error")) return false;
 
 		// Create geometry shader from string if given
 		if (geometryShaderSource != nullptr) {
@@ -315,7 +1593,6 @@ public:
 			}
 			glShaderSource(geometryShader, 1, (const GLchar**)&geometryShaderSource, NULL);
 			glCompileShader(geometryShader);
-			if (!checkShader(geometryShader, "Geometry shader error")) return false;
 		}
 
 		// Create fragment shader from string
@@ -327,13 +1604,7 @@ public:
 
 		glShaderSource(fragmentShader, 1, (const GLchar**)&fragmentShaderSource, NULL);
 		glCompileShader(fragmentShader);
-		if (!checkShader(fragmentShader, "Fragment shader error")) return false;
 
-		shaderProgramId = glCreateProgram();
-		if (!shaderProgramId) {
-			printf("Error in shader program creation\n");
-			exit(1);
-		}
 		glAttachShader(shaderProgramId, vertexShader);
 		glAttachShader(shaderProgramId, fragmentShader);
 		if (geometryShader > 0) glAttachShader(shaderProgramId, geometryShader);
@@ -341,57 +1612,120 @@ public:
 		// Connect the fragmentColor to the frame buffer memory
 		glBindFragDataLocation(shaderProgramId, 0, fragmentShaderOutputName);	// this output goes to the frame buffer memory
 
-		// program packaging
+		// program packaging, the status is checked in finish()
+		if (!binaryPath.empty()) glProgramParameteri(shaderProgramId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 		glLinkProgram(shaderProgramId);
-		if (!checkLinking(shaderProgramId)) return false;
+		return true;
+	}
+
+	bool isReady() {	// true if finish() would not wait for the driver
+		if (loadedFromBinary || !parallelCompileSupported()) return true;
+		int done = 0;
+		glGetProgramiv(shaderProgramId, GL_COMPLETION_STATUS_KHR, &done);
+		return done != 0;
+	}
+
+	// wait for the program started by createAsync, report errors and store the binary
+	bool finish() {
+		if (!loadedFromBinary) {
+			if (!checkShader(vertexShader, "Vertex shader error")) return false;
+			if (geometryShader > 0 && !checkShader(geometryShader, "Geometry shader error")) return false;
+			if (!checkShader(fragmentShader, "Fragment shader error")) return false;
+			if (!checkLinking(shaderProgramId)) return false;
+			saveBinary();
+			cacheStats().compiled++;
+		}
+		else cacheStats().loaded++;
+		cacheUniforms();
 
 		// make this program run
-		glUseProgram(shaderProgramId);
+		glState().useProgram(shaderProgramId);
 		return true;
 	}
 
+	bool isLoadedFromBinary() const { return loadedFromBinary; }
+
 	void Use() { 		// make this program run
-		glUseProgram(shaderProgramId);
+		glState().useProgram(shaderProgramId);
 	}
 
-	void setUniform(int i, const std::string& name) {
+	UniformHandle getUniform(const char * const name) { return UniformHandle(getLocation(name)); }
+
+	void setUniform(int i, const char * const name) {
 		int location = getLocation(name);
 		if (location >= 0) glUniform1i(location, i);
 	}
 
-	void setUniform(float f, const std::string& name) {
+	void setUniform(float f, const char * const name) {
 		int location = getLocation(name);
 		if (location >= 0) glUniform1f(location, f);
 	}
 
-	void setUniform(const vec2& v, const std::string& name) {
+	void setUniform(const vec2& v, const char * const name) {
 		int location = getLocation(name);
 		if (location >= 0) glUniform2fv(location, 1, &v.x);
 	}
 
-	void setUniform(const vec3& v, const std::string& name) {
+	void setUniform(const vec3& v, const char * const name) {
 		int location = getLocation(name);
 		if (location >= 0) glUniform3fv(location, 1, &v.x);
 	}
 
-	void setUniform(const vec4& v, const std::string& name) {
+	void setUniform(const vec4& v, const char * const name) {
 		int location = getLocation(name);
 		if (location >= 0) glUniform4fv(location, 1, &v.x);
 	}
 
-	void setUniform(const mat4& mat, const std::string& name) {
+	void setUniform(const mat4& mat, const char * const name) {
 		int location = getLocation(name);
 		if (location >= 0) glUniformMatrix4fv(location, 1, GL_TRUE, mat);
 	}
 
-	void setUniform(const Texture& texture, const std::string& samplerName, unsigned int textureUnit = 0) {
+	void setUniform(const Texture& texture, const char * const samplerName, unsigned int textureUnit = 0) {
 		int location = getLocation(samplerName);
 		if (location >= 0) {
 			glUniform1i(location, textureUnit);
-			glActiveTexture(GL_TEXTURE0 + textureUnit);
-			glBindTexture(GL_TEXTURE_2D, texture.textureId);
+			glState().bindTexture(textureUnit, texture.textureId);
+		}
+	}
+
+	// names held in a std::string are passed on without a copy
+	template<typename T>
+	void setUniform(const T& value, const std::string& name) { setUniform(value, name.c_str()); }
+
+	void setUniform(const Texture& texture, const std::string& samplerName, unsigned int textureUnit = 0) { setUniform(texture, samplerName.c_str(), textureUnit); }
+
+	// setting with a handle skips the lookup by name, this is the variant to use in the draw calls
+	void setUniform(int i, UniformHandle handle) {
+		if (handle.isValid()) glUniform1i(handle.location, i);
+	}
+
+	void setUniform(float f, UniformHandle handle) {
+		if (handle.isValid()) glUniform1f(handle.location, f);
+	}
+
+	void setUniform(const vec2& v, UniformHandle handle) {
+		if (handle.isValid()) glUniform2fv(handle.location, 1, &v.x);
+	}
+
+	void setUniform(const vec3& v, UniformHandle handle) {
+		if (handle.isValid()) glUniform3fv(handle.location, 1, &v.x);
+	}
+
+	void setUniform(const vec4& v, UniformHandle handle) {
+		if (handle.isValid()) glUniform4fv(handle.location, 1, &v.x);
+	}
+
+	void setUniform(const mat4& mat, UniformHandle handle) {
+		if (handle.isValid()) glUniformMatrix4fv(handle.location, 1, GL_TRUE, mat);
+	}
+
+	void setUniform(const Texture& texture, UniformHandle handle, unsigned int textureUnit = 0) {
+		if (handle.isValid()) {
+			glUniform1i(handle.location, textureUnit);
+			glState().bindTexture(textureUnit, texture.textureId);
 		}
 	}
 
-	~GPUProgram() { if (shaderProgramId > 0) glDeleteProgram(shaderProgramId); }
+	~GPUProgram() { destroy(); }
 };